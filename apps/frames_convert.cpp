@@ -0,0 +1,32 @@
+#include "frame_cache.h"
+#include <iostream>
+
+// example input: ./frames_convert frames.txt frames.bin
+// converts the text animation frames to the binary cache read by LoadPosFrames
+
+int main(int argc, char *argv[])
+{
+    if (argc<3)
+    {
+        std::cout<<"Usage: frames_convert <text frames> <binary frames>"<<std::endl;
+        return 1;
+    }
+
+    std::string pathText(argv[1]);
+    std::string pathBinary(argv[2]);
+    if (!FrameCache::ConvertText(pathText,pathBinary))
+    {
+        std::cout<<"Error Converting "<<pathText<<std::endl;
+        return 1;
+    }
+
+    FrameCache Frames;
+    if (!Frames.OpenBinary(pathBinary))
+    {
+        std::cout<<"Error Loading "<<pathBinary<<std::endl;
+        return 1;
+    }
+    std::cout<<"Saved "<<Frames.NumFrames()<<" frames of "<<Frames.NumVerts()
+             <<" vertices to "<<pathBinary<<std::endl;
+    return 0;
+}
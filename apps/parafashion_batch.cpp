@@ -0,0 +1,210 @@
+#include <tracing/mesh_type.h>
+#include <svg_exporter.h>
+#include "parafashion.h"
+#include "parafashion_io.h"
+#include <clocale>
+
+// example input: ./parafashion_batch ../data/wet/wet.obj -c ../data/wet/constraints.txt
+
+void PrintUsage()
+{
+    std::cout<<"Usage: parafashion_batch <deformed mesh> [reference mesh] [frames]"<<std::endl;
+    std::cout<<"       [-c constraints.txt] [-o output prefix] [-d (save debug patches)]"<<std::endl;
+    std::cout<<"       [-p (estimate the quality on a decimated proxy first)]"<<std::endl;
+    std::cout<<"       [-s (estimate the symmetry plane, for meshes not aligned on x=0)]"<<std::endl;
+    std::cout<<"       [-f (process the full mesh, for asymmetric garments)]"<<std::endl;
+    std::cout<<"       [-m double|float|quantized (precision of the per frame data)]"<<std::endl;
+    std::cout<<"       [-k checkpoint prefix] [-r field|trace (resume from the checkpoint)]"<<std::endl;
+    std::cout<<"       [-j profiling report.json]"<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    //Use "." as decimal separator
+    std::setlocale(LC_NUMERIC, "en_US.UTF-8");
+
+    std::string pathDef,pathRef,pathFrames,pathConstr,ProjM,pathCheckpoint,pathReport;
+    PipelineStage resumeFrom=PSNone;
+    bool saveDebug=false;
+    bool useProxy=false;
+    bool autoPlane=false;
+    bool fullMesh=false;
+    FieldPrecision framePrecision=FPDouble;
+
+    std::vector<std::string> Positional;
+    for (int i=1;i<argc;i++)
+    {
+        std::string Arg(argv[i]);
+        if ((Arg=="-c")&&(i+1<argc))
+            pathConstr=std::string(argv[++i]);
+        else if ((Arg=="-o")&&(i+1<argc))
+            ProjM=std::string(argv[++i]);
+        else if ((Arg=="-j")&&(i+1<argc))
+            pathReport=std::string(argv[++i]);
+        else if ((Arg=="-k")&&(i+1<argc))
+            pathCheckpoint=std::string(argv[++i]);
+        else if ((Arg=="-r")&&(i+1<argc))
+        {
+            std::string Stage(argv[++i]);
+            if (Stage=="field")
+                resumeFrom=PSField;
+            else if (Stage=="trace")
+                resumeFrom=PSTrace;
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if ((Arg=="-m")&&(i+1<argc))
+        {
+            std::string Precision(argv[++i]);
+            if (Precision=="double")
+                framePrecision=FPDouble;
+            else if (Precision=="float")
+                framePrecision=FPFloat;
+            else if (Precision=="quantized")
+                framePrecision=FPQuantized;
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (Arg=="-p")
+            useProxy=true;
+        else if (Arg=="-s")
+            autoPlane=true;
+        else if (Arg=="-f")
+            fullMesh=true;
+        else if (Arg=="-d")
+            saveDebug=true;
+        else
+            Positional.push_back(Arg);
+    }
+
+    if (Positional.size()==0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    pathDef=Positional[0];
+    std::cout <<"Loading Deformed Mesh "<< pathDef << std::endl;
+
+    if (Positional.size()>1)
+        pathRef=Positional[1];
+    else pathRef = pathDef;
+    std::cout <<"Loading Reference Mesh "<< pathRef << std::endl;
+
+    if (Positional.size()>2)
+    {
+        pathFrames=Positional[2];
+        std::cout <<"Loading Frames "<< pathFrames << std::endl;
+    }
+
+    if (ProjM.empty())
+    {
+        ProjM=pathDef;
+        size_t indexExt=ProjM.find_last_of(".");
+        ProjM=ProjM.substr(0,indexExt);
+    }
+
+    TraceMesh deformed_mesh;
+    TraceMesh reference_mesh;
+
+    bool Loaded=deformed_mesh.LoadMesh(pathDef.c_str());
+    if (!Loaded)
+    {
+        std::cout<<"Error Loading Mesh"<<std::endl;
+        return 1;
+    }
+    std::cout<<"Loaded "<<deformed_mesh.face.size()<<" faces of deformed mesh "<<std::endl;
+    deformed_mesh.UpdateAttributes();
+
+    Loaded=reference_mesh.LoadMesh(pathRef.c_str());
+    if (!Loaded)
+    {
+        std::cout<<"Error Loading Mesh"<<std::endl;
+        return 1;
+    }
+    std::cout<<"Loaded "<<reference_mesh.face.size()<<" faces of reference mesh "<<std::endl;
+    reference_mesh.UpdateAttributes();
+
+    reference_mesh.MoveCenterOnZero();
+    typename TraceMesh::CoordType CenterDef=deformed_mesh.MoveCenterOnZero();
+
+    //constraints are given in the frame of the input mesh
+    std::vector<std::vector<typename TraceMesh::CoordType> > PickedPoints;
+    if (!pathConstr.empty())
+    {
+        if (!LoadConstraintPolylines(pathConstr,PickedPoints))
+        {
+            std::cout<<"Error Loading Constraints"<<std::endl;
+            return 1;
+        }
+        for (size_t i=0;i<PickedPoints.size();i++)
+            for (size_t j=0;j<PickedPoints[i].size();j++)
+                PickedPoints[i][j]-=CenterDef;
+        std::cout<<"Loaded "<<PickedPoints.size()<<" constraint polylines"<<std::endl;
+    }
+
+    AnimationManager<TraceMesh> AManager(deformed_mesh);
+    Parafashion<TraceMesh> PFashion(deformed_mesh,reference_mesh,AManager);
+
+    if (!pathFrames.empty())
+    {
+        AManager.Init();
+        if (!AManager.LoadPosFrames(pathFrames.c_str()))
+        {
+            std::cout<<"Error Loading Frames"<<std::endl;
+            return 1;
+        }
+    }
+
+    PFashion.proxy_quality=useProxy;
+    PFashion.auto_symmetry_plane=autoPlane;
+    PFashion.use_symmetry=!fullMesh;
+    PFashion.field_precision=framePrecision;
+    PFashion.checkpoint_prefix=pathCheckpoint;
+    if ((resumeFrom!=PSNone)&&(pathCheckpoint.empty()))
+        PFashion.checkpoint_prefix=ProjM;
+    PFashion.resume_from=resumeFrom;
+    PFashion.Init();
+    PFashion.BatchProcess(PickedPoints,AManager);
+
+    //SAVE THE OUTPUT, same files as the GUI's "Save Data"
+    if (saveDebug)
+        PFashion.SaveDebugPatches(ProjM);
+
+    SavePatchMesh(deformed_mesh,ProjM+"_patch.obj",CenterDef);
+
+    if (!SavePatchPartition(deformed_mesh,ProjM+"_patch.txt"))
+    {
+        std::cout<<"Error Saving Partition"<<std::endl;
+        return 1;
+    }
+
+    std::string pathPatch=ProjM+"_patch.svg";
+    float scale=1000;
+    if (!SvgExporter<TraceMesh>::ExportUVPolylineSVG(deformed_mesh,pathPatch.c_str(),scale))
+    {
+        std::cout<<"Error Saving SVG"<<std::endl;
+        return 1;
+    }
+
+    if (!SavePerWedgeUV(deformed_mesh,ProjM+"_UV.txt"))
+    {
+        std::cout<<"Error Saving UV"<<std::endl;
+        return 1;
+    }
+
+    Profiler::Get().PrintReport();
+    if ((!pathReport.empty())&&(!Profiler::Get().SaveReport(pathReport)))
+    {
+        std::cout<<"Error Saving Profiling Report"<<std::endl;
+        return 1;
+    }
+
+    return 0;
+}
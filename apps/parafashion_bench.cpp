@@ -0,0 +1,184 @@
+#include <tracing/mesh_type.h>
+#include "parafashion.h"
+#include <clocale>
+#include <set>
+
+// example input: ./parafashion_bench ../data -o bench
+// runs the headless pipeline with the default parameters on the bundled garments
+
+struct BenchDataset
+{
+    std::string Name;
+    std::string Mesh;
+};
+
+struct BenchResult
+{
+    std::string Name;
+    size_t Faces;
+    double TimeSymm,TimeField,TimeTrace,TimeParam;
+    size_t ClothParamCalls;
+    size_t QualityCalls;
+    size_t PeakRSS;
+    size_t Patches;
+    double MinStretch,MaxStretch;
+};
+
+void GetDatasets(std::vector<BenchDataset> &Datasets)
+{
+    Datasets.clear();
+    Datasets.push_back({"dress","dress/dress.ply"});
+    Datasets.push_back({"katja","katja/dress_09.obj"});
+    Datasets.push_back({"leggins","leggins/leggins.ply"});
+    Datasets.push_back({"mark_skirt","mark_skirt/mark_skirt_uncut.obj"});
+    Datasets.push_back({"wet","wet/wet.obj"});
+    Datasets.push_back({"wet_cedric","wet_cedric/wet_input.ply"});
+}
+
+bool RunDataset(const std::string &pathMesh,
+                BenchResult &Res)
+{
+    TraceMesh deformed_mesh;
+    TraceMesh reference_mesh;
+
+    if (!deformed_mesh.LoadMesh(pathMesh.c_str()))return false;
+    if (!reference_mesh.LoadMesh(pathMesh.c_str()))return false;
+    deformed_mesh.UpdateAttributes();
+    reference_mesh.UpdateAttributes();
+    reference_mesh.MoveCenterOnZero();
+    deformed_mesh.MoveCenterOnZero();
+    Res.Faces=deformed_mesh.face.size();
+
+    AnimationManager<TraceMesh> AManager(deformed_mesh);
+    Parafashion<TraceMesh> PFashion(deformed_mesh,reference_mesh,AManager);
+    PFashion.Init();
+
+    Profiler::Get().Clear();
+    #ifdef COUNT_PARAM_CALLS
+    param_calls_count=0;
+    #endif
+
+    std::vector<std::vector<typename TraceMesh::CoordType> > PickedPoints;
+    PFashion.BatchProcess(PickedPoints,AManager);
+
+    Res.TimeSymm=Profiler::Get().Stats("stage_symmetrize").Wall;
+    Res.TimeField=Profiler::Get().Stats("stage_field").Wall;
+    Res.TimeTrace=Profiler::Get().Stats("stage_trace").Wall;
+    Res.TimeParam=Profiler::Get().Stats("stage_param").Wall;
+    Res.ClothParamCalls=Profiler::Get().Stats("cloth_param").Calls;
+    Res.QualityCalls=Profiler::Get().Stats("quality").Calls;
+    Res.PeakRSS=PeakMemoryBytes();
+
+    std::set<int> Partitions;
+    for (size_t i=0;i<deformed_mesh.face.size();i++)
+        Partitions.insert((int)deformed_mesh.face[i].Q());
+    Res.Patches=Partitions.size();
+
+    typename TraceMesh::ScalarType MinS,MaxS;
+    MeshStretchRange(deformed_mesh,MinS,MaxS);
+    Res.MinStretch=MinS;
+    Res.MaxStretch=MaxS;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    //Use "." as decimal separator
+    std::setlocale(LC_NUMERIC, "en_US.UTF-8");
+
+    std::string pathData="../data";
+    std::string ProjM="bench";
+    std::set<std::string> Selected;
+
+    bool HasDataPath=false;
+    for (int i=1;i<argc;i++)
+    {
+        std::string Arg(argv[i]);
+        if ((Arg=="-o")&&(i+1<argc))
+            ProjM=std::string(argv[++i]);
+        else if ((Arg=="-s")&&(i+1<argc))
+            Selected.insert(std::string(argv[++i]));
+        else if (!HasDataPath)
+        {
+            pathData=Arg;
+            HasDataPath=true;
+        }
+        else
+        {
+            std::cout<<"Usage: parafashion_bench [data folder] [-o output prefix]"<<std::endl;
+            std::cout<<"       [-s dataset (can be repeated)]"<<std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<BenchDataset> Datasets;
+    GetDatasets(Datasets);
+
+    std::vector<BenchResult> Results;
+    nlohmann::json Report=nlohmann::json::array();
+    for (size_t i=0;i<Datasets.size();i++)
+    {
+        if ((Selected.size()>0)&&(Selected.count(Datasets[i].Name)==0))continue;
+
+        std::string pathMesh=pathData+"/"+Datasets[i].Mesh;
+        std::cout<<"*** BENCHMARK "<<Datasets[i].Name<<" ("<<pathMesh<<")"<<std::endl;
+
+        BenchResult Res;
+        Res.Name=Datasets[i].Name;
+        if (!RunDataset(pathMesh,Res))
+        {
+            std::cout<<"Error Loading Mesh "<<pathMesh<<std::endl;
+            return 1;
+        }
+        Results.push_back(Res);
+
+        nlohmann::json Curr;
+        Curr["dataset"]=Res.Name;
+        Curr["faces"]=Res.Faces;
+        Curr["symmetrize_s"]=Res.TimeSymm;
+        Curr["field_s"]=Res.TimeField;
+        Curr["trace_s"]=Res.TimeTrace;
+        Curr["param_s"]=Res.TimeParam;
+        Curr["cloth_param_calls"]=Res.ClothParamCalls;
+        Curr["quality_calls"]=Res.QualityCalls;
+        Curr["peak_rss_bytes"]=Res.PeakRSS;
+        Curr["patches"]=Res.Patches;
+        Curr["min_stretch"]=Res.MinStretch;
+        Curr["max_stretch"]=Res.MaxStretch;
+        Curr["profile"]=Profiler::Get().Report();
+        Report.push_back(Curr);
+    }
+
+    //the peak RSS is the one of the process, so it never decreases
+    //from a dataset to the next: use -s to measure a single garment
+    std::string pathCSV=ProjM+".csv";
+    FILE *f=fopen(pathCSV.c_str(),"wt");
+    if (f==NULL)
+    {
+        std::cout<<"Error Saving "<<pathCSV<<std::endl;
+        return 1;
+    }
+    fprintf(f,"dataset,faces,symmetrize_s,field_s,trace_s,param_s,cloth_param_calls,quality_calls,peak_rss_mb,patches,min_stretch,max_stretch\n");
+    for (size_t i=0;i<Results.size();i++)
+        fprintf(f,"%s,%d,%f,%f,%f,%f,%d,%d,%f,%d,%f,%f\n",
+                Results[i].Name.c_str(),(int)Results[i].Faces,
+                Results[i].TimeSymm,Results[i].TimeField,
+                Results[i].TimeTrace,Results[i].TimeParam,
+                (int)Results[i].ClothParamCalls,(int)Results[i].QualityCalls,
+                Results[i].PeakRSS/(1024.0*1024.0),(int)Results[i].Patches,
+                Results[i].MinStretch,Results[i].MaxStretch);
+    fclose(f);
+
+    std::string pathJSON=ProjM+".json";
+    f=fopen(pathJSON.c_str(),"wt");
+    if (f==NULL)
+    {
+        std::cout<<"Error Saving "<<pathJSON<<std::endl;
+        return 1;
+    }
+    fprintf(f,"%s\n",Report.dump(2).c_str());
+    fclose(f);
+
+    std::cout<<"Saved "<<pathCSV<<" and "<<pathJSON<<std::endl;
+    return 0;
+}
@@ -2,11 +2,29 @@
 #define ANIMATION_MANAGER
 
 #include <vector>
+#include <map>
 #include <vcg/space/index/grid_static_ptr.h>
 #include <vcg/complex/algorithms/closest.h>
+#include "projection_index.h"
+#include "frame_cache.h"
+#include "parallel_for.h"
+#include "quantile_sketch.h"
+#include "frame_field_store.h"
 
 #define ANISOTR_PERCENTILE 0.1
 
+//per frame data that UpdateAnimationMesh carries over to the new mesh,
+//positions are always carried over as everything else derives from them;
+//what is not carried over is dropped and recomputed on the new template if
+//needed later: the jacobians then refer to the rest positions of the new
+//template instead of the original ones, so keep ADStretch to preserve them
+enum AnimationData{ADCurvature=1,ADStretch=2,ADAll=3};
+
+//how the poses for the multi pose parametrization are picked:
+//evenly spaced, the most stretched ones, or the most different ones
+//(greedy k-center clustering of the poses, starting from the rest pose)
+enum FrameSelection{FSUniform,FSMaxStretch,FSCluster};
+
 template <class FaceType>
 class Jacobian{
     typedef typename FaceType::VertexType VertexType;
@@ -40,7 +58,7 @@ class AnimationManager
     typedef typename TriMeshType::ScalarType ScalarType;
 
     //per frame per vert position
-    std::vector<std::vector<CoordType> > PerFramePos;
+    FrameCache PerFramePos;
 
     //    //per frame deformation tensor
     //    std::vector<std::vector<CoordType> > PerFrameCurvAnis;
@@ -51,6 +69,15 @@ class AnimationManager
     //reprojecting onto the copy mesh
     std::vector<size_t> VertFaceIdx;
     std::vector<CoordType> VertFaceBary;
+    //positions of target_shape when the two above have been computed
+    std::vector<CoordType> VertFacePos;
+
+    //kept across calls, rebuilt only if the meshes change
+    ProjectionIndex<TriMeshType> TemplateIndex;
+    ProjectionIndex<TriMeshType> TargetIndex;
+
+    //per vertex projection of other meshes on the template
+    std::map<const TriMeshType*,ProjectionBasis<CoordType> > MeshBasis;
 
     //reprojecting onto the copy mesh
     std::vector<size_t> FaceFaceIdx;
@@ -59,16 +86,16 @@ class AnimationManager
     TriMeshType animated_template_shape;
 
     //per frame normal
-    std::vector<std::vector<CoordType> > PerFrameNormVect;
+    FrameVectorField<CoordType> PerFrameNormVect;
 
     //per frame curvature
-    std::vector<std::vector<CoordType> > PerFrameCurvVect;
+    FrameVectorField<CoordType> PerFrameCurvVect;
 
     //per frame curvature anisotropy
-    std::vector<std::vector<ScalarType> > PerFrameCurvAnis;
+    FrameScalarField<ScalarType> PerFrameCurvAnis;
 
     //per frame Jacobian first and Second Direction
-    std::vector<std::vector<CoordType> > JU,JV;
+    FrameVectorField<CoordType> JU,JV;
 
     //target curvature and weight
     std::vector<CoordType> TargetVect;
@@ -95,6 +122,12 @@ class AnimationManager
 
     CoordType InterpolatePos(size_t IndexV,size_t IndexFrame);
 
+    CoordType FramePos(size_t IndexFrame,size_t IndexV)const;
+
+    void UpdateTemplateIndex();
+
+    const ProjectionBasis<CoordType> &GetVertBasis(const TriMeshType &target);
+
     ScalarType percentileAnis;
     //ScalarType percentileAnisRest;
     ScalarType percentileStretchCompress;
@@ -102,6 +135,10 @@ class AnimationManager
 
     void UpdateTemplateToFrame(size_t IndexFrame);
 
+    void InitScratchMesh(TriMeshType &scratch);
+
+    void UpdateScratchToFrame(TriMeshType &scratch,size_t IndexFrame)const;
+
     void InitPerFrameCurvature();
 
     ScalarType getKForStretchCompression(CoordType Vect);
@@ -116,8 +153,20 @@ class AnimationManager
 
     void UpdateFaceStretchField(size_t IndexFrame);
 
+    //compute from the positions what has not been computed yet, or what
+    //UpdateAnimationMesh has dropped
+    void EnsureCurvature();
+
+    void EnsureStretch();
+
 public:
 
+    //threads used to precompute the per frame data, 0 means one per core
+    size_t frame_threads;
+
+    //precision used to store the per frame data
+    FieldPrecision field_precision;
+
     ScalarType MaxAnisotropy();
 
     ScalarType MaxStretchCompress();
@@ -134,6 +183,9 @@ public:
 
     size_t NumFrames()const;
 
+    //per frame per vert positions as loaded
+    const FrameCache &PosFrames()const;
+
     void UpdateToFrame(size_t IndexFrame,
                        bool UpdateCurvature=false,
                        bool UpdateStretch=false);
@@ -147,16 +199,20 @@ public:
 
     void InitTargetDirectionsOnMesh();
 
-    void UpdateAnimationMesh();
+    void UpdateAnimationMesh(int Needed=ADAll);
 
     void TransferDirOnMesh(TriMeshType &target);
 
     void InterpolatePosOnMesh(TriMeshType &target,size_t IndexFrame,
                       std::vector<CoordType> &VertPos);
 
+    void SelectFrames(FrameSelection Mode,size_t Budget,
+                      std::vector<size_t> &Frames);
+
     void InterpolateMultipleFramesOnMesh(TriMeshType &target,
-                                    size_t FrameInterval,
+                                    size_t Budget,
                                     std::vector<std::vector<CoordType> > &VertPos,
+                                    FrameSelection Mode=FSCluster,
                                     bool add_rest=true);
  //   void UpdateRestInfo();
 
@@ -245,8 +301,8 @@ void AnimationManager<TriMeshType>::InterpolateFaceField(const size_t &IndexFace
 {
     assert(IndexFace<target_shape.face.size());
     assert(IndexFrame<NumFrames());
-    assert(IndexFrame<JU.size());
-    assert(IndexFrame<JV.size());
+    assert(IndexFrame<PerFrameCurvVect.size());
+    assert(IndexFrame<PerFrameCurvAnis.size());
     assert(IndexFace<target_shape.face.size());
 
     assert(IndexFace<FaceFaceIdx.size());
@@ -289,7 +345,7 @@ template <class TriMeshType>
 typename TriMeshType::CoordType AnimationManager<TriMeshType>::InterpolatePos(size_t IndexV,size_t IndexFrame)
 {
     assert(IndexV<target_shape.vert.size());
-    assert(IndexFrame<PerFramePos.size());
+    assert(IndexFrame<PerFramePos.NumFrames());
     assert(IndexV<VertFaceIdx.size());
 
     size_t IndexF=VertFaceIdx[IndexV];
@@ -312,64 +368,94 @@ typename TriMeshType::CoordType AnimationManager<TriMeshType>::InterpolatePos(si
     size_t IndexV1=vcg::tri::Index(animated_template_shape,V1);
     size_t IndexV2=vcg::tri::Index(animated_template_shape,V2);
 
-    CoordType P0=PerFramePos[IndexFrame][IndexV0];
-    CoordType P1=PerFramePos[IndexFrame][IndexV1];
-    CoordType P2=PerFramePos[IndexFrame][IndexV2];
+    CoordType P0=FramePos(IndexFrame,IndexV0);
+    CoordType P1=FramePos(IndexFrame,IndexV1);
+    CoordType P2=FramePos(IndexFrame,IndexV2);
 
     return (P0*Bary.X()+P1*Bary.Y()+P2*Bary.Z());
 }
 
+template <class TriMeshType>
+typename TriMeshType::CoordType AnimationManager<TriMeshType>::FramePos(size_t IndexFrame,size_t IndexV)const
+{
+    assert(IndexFrame<PerFramePos.NumFrames());
+    assert(IndexV<PerFramePos.NumVerts());
+    const float *P=PerFramePos.Vert(IndexFrame,IndexV);
+    return CoordType((ScalarType)P[0],(ScalarType)P[1],(ScalarType)P[2]);
+}
+
 template <class TriMeshType>
 void AnimationManager<TriMeshType>::UpdateTemplateToFrame(size_t IndexFrame)
 {
-    assert(IndexFrame<PerFramePos.size());
-    assert(PerFramePos[IndexFrame].size()==animated_template_shape.vert.size());
+    assert(IndexFrame<PerFramePos.NumFrames());
+    assert(PerFramePos.NumVerts()==animated_template_shape.vert.size());
 
     for (size_t i=0;i<animated_template_shape.vert.size();i++)
-        animated_template_shape.vert[i].P()=PerFramePos[IndexFrame][i];
+        animated_template_shape.vert[i].P()=FramePos(IndexFrame,i);
 
     animated_template_shape.UpdateAttributes();
 }
 
+//a copy of the template each worker can move to any frame,
+//RPos is not a vcg component so it is not copied by Append
 template <class TriMeshType>
-void AnimationManager<TriMeshType>::InitPerFrameCurvature()
+void AnimationManager<TriMeshType>::InitScratchMesh(TriMeshType &scratch)
 {
-    if (NumFrames()==0)return;
-    PerFrameCurvVect.clear();
-    PerFrameCurvAnis.clear();
-    PerFrameNormVect.clear();
+    scratch.Clear();
+    vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(scratch,animated_template_shape);
+    for (size_t i=0;i<scratch.vert.size();i++)
+        scratch.vert[i].RPos=animated_template_shape.vert[i].RPos;
+    scratch.UpdateAttributes();
+}
 
-    PerFrameCurvVect.resize(NumFrames());
-    PerFrameCurvAnis.resize(NumFrames());
-    PerFrameNormVect.resize(NumFrames());
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::UpdateScratchToFrame(TriMeshType &scratch,size_t IndexFrame)const
+{
+    assert(IndexFrame<PerFramePos.NumFrames());
+    assert(PerFramePos.NumVerts()==scratch.vert.size());
 
-    std::vector<ScalarType> AnisValue;
+    for (size_t i=0;i<scratch.vert.size();i++)
+        scratch.vert[i].P()=FramePos(IndexFrame,i);
 
-    //animated_template_shape.InitRPos();
+    scratch.UpdateAttributes();
+}
 
-    for (size_t i=0;i<NumFrames();i++)
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::InitPerFrameCurvature()
+{
+    if (NumFrames()==0)return;
+    size_t NumF=animated_template_shape.face.size();
+    PerFrameCurvVect.Allocate(NumFrames(),NumF,field_precision);
+    PerFrameCurvAnis.Allocate(NumFrames(),NumF,field_precision);
+    PerFrameNormVect.Allocate(NumFrames(),NumF,field_precision);
+
+    //frames are independent, each worker moves its own copy of the template
+    //and collects the anisotropy values of its frames in its own sketch
+    std::vector<QuantileSketch<ScalarType> > AnisSketch(NumWorkerThreads(frame_threads));
+    ParallelForRange(NumFrames(),frame_threads,
+                     [&](size_t Begin,size_t End,size_t IndexThread)
     {
-        UpdateTemplateToFrame(i);
-        DirectionalFieldSmoother<TriMeshType>::InitByCurvature(animated_template_shape,4);
-        for (size_t j=0;j<animated_template_shape.face.size();j++)
+        TriMeshType scratch;
+        InitScratchMesh(scratch);
+        for (size_t i=Begin;i<End;i++)
         {
-            PerFrameCurvVect[i].push_back(animated_template_shape.face[j].PD1());
-            PerFrameCurvAnis[i].push_back(animated_template_shape.face[j].Q());
-            PerFrameNormVect[i].push_back(animated_template_shape.face[j].N());
-
-            AnisValue.push_back(animated_template_shape.face[j].Q());
+            UpdateScratchToFrame(scratch,i);
+            DirectionalFieldSmoother<TriMeshType>::InitByCurvature(scratch,4);
+            for (size_t j=0;j<scratch.face.size();j++)
+            {
+                PerFrameCurvVect.Set(i,j,scratch.face[j].PD1());
+                PerFrameCurvAnis.Set(i,j,scratch.face[j].Q());
+                PerFrameNormVect.Set(i,j,scratch.face[j].N());
+                AnisSketch[IndexThread].Add(scratch.face[j].Q());
+            }
         }
-    }
-    animated_template_shape.RestoreRPos();
-    animated_template_shape.UpdateAttributes();
+    });
 
-    //then get the percentile of anisotropy
-    std::sort(AnisValue.begin(),AnisValue.end());
-    size_t Index_Percentile=(AnisValue.size()*(1-ANISOTR_PERCENTILE));
-    //        std::cout<<"Index:"<<Index_Percentile<<std::endl;
-    //        std::cout<<"Size:"<<AnisValue.size()<<std::endl;
+    for (size_t i=1;i<AnisSketch.size();i++)
+        AnisSketch[0].Merge(AnisSketch[i]);
 
-    percentileAnis=AnisValue[Index_Percentile];
+    //then get the percentile of anisotropy
+    percentileAnis=AnisSketch[0].Quantile(1-ANISOTR_PERCENTILE);
     //       std::cout<<"Value:"<<percentileAnis<<std::endl;
 }
 
@@ -395,40 +481,38 @@ template <class TriMeshType>
 void AnimationManager<TriMeshType>::InitPerFrameJacobian()
 {
     if (NumFrames()==0)return;
-    JU.clear();
-    JV.clear();
+    size_t NumF=animated_template_shape.face.size();
+    JU.Allocate(NumFrames(),NumF,field_precision);
+    JV.Allocate(NumFrames(),NumF,field_precision);
 
-    JU.resize(NumFrames());
-    JV.resize(NumFrames());
-
-    std::vector<ScalarType> JValue;
-
-    for (size_t i=0;i<NumFrames();i++)
+    std::vector<QuantileSketch<ScalarType> > JSketch(NumWorkerThreads(frame_threads));
+    ParallelForRange(NumFrames(),frame_threads,
+                     [&](size_t Begin,size_t End,size_t IndexThread)
     {
-        UpdateTemplateToFrame(i);
-        for (size_t j=0;j<animated_template_shape.face.size();j++)
+        TriMeshType scratch;
+        InitScratchMesh(scratch);
+        for (size_t i=Begin;i<End;i++)
         {
-            CoordType U,V;
-            Jacobian<FaceType>::FromFace(animated_template_shape.face[j],U,V);
-            JU[i].push_back(U);
-            JV[i].push_back(V);
-
-
-            ScalarType KValU=getKForStretchCompression(U);
-            ScalarType KValV=getKForStretchCompression(V);
-            JValue.push_back(fabs(KValU));
-            JValue.push_back(fabs(KValV));
+            UpdateScratchToFrame(scratch,i);
+            for (size_t j=0;j<scratch.face.size();j++)
+            {
+                CoordType FaceJU,FaceJV;
+                Jacobian<FaceType>::FromFace(scratch.face[j],FaceJU,FaceJV);
+                JU.Set(i,j,FaceJU);
+                JV.Set(i,j,FaceJV);
+
+                ScalarType KValU=getKForStretchCompression(FaceJU);
+                ScalarType KValV=getKForStretchCompression(FaceJV);
+                JSketch[IndexThread].Add(fabs(KValU));
+                JSketch[IndexThread].Add(fabs(KValV));
+            }
         }
-    }
-    animated_template_shape.RestoreRPos();
-    animated_template_shape.UpdateAttributes();
-
-    std::sort(JValue.begin(),JValue.end());
-
+    });
 
-    size_t Index_Percentile_Stretch_Compress=(JValue.size()*(1-ANISOTR_PERCENTILE));
+    for (size_t i=1;i<JSketch.size();i++)
+        JSketch[0].Merge(JSketch[i]);
 
-    percentileStretchCompress=JValue[Index_Percentile_Stretch_Compress];
+    percentileStretchCompress=JSketch[0].Quantile(1-ANISOTR_PERCENTILE);
 }
 
 template <class TriMeshType>
@@ -470,6 +554,7 @@ template <class TriMeshType>
 void AnimationManager<TriMeshType>::UpdateFaceCurvatureField(size_t IndexFrame)
 {
     assert(IndexFrame<NumFrames());
+    EnsureCurvature();
     for (size_t i=0;i<target_shape.face.size();i++)
     {
         CoordType InterpCurvDirection;
@@ -492,6 +577,7 @@ template <class TriMeshType>
 void AnimationManager<TriMeshType>::UpdateFaceStretchField(size_t IndexFrame)
 {
     assert(IndexFrame<NumFrames());
+    EnsureStretch();
 
     //        ScalarType minV=std::numeric_limits<ScalarType>::max();
     //        ScalarType maxV=std::numeric_limits<ScalarType>::min();
@@ -508,15 +594,31 @@ void AnimationManager<TriMeshType>::UpdateFaceStretchField(size_t IndexFrame)
     }
 }
 
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::EnsureCurvature()
+{
+    if (PerFrameCurvAnis.size()==NumFrames())return;
+    InitPerFrameCurvature();
+}
+
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::EnsureStretch()
+{
+    if (JU.size()==NumFrames())return;
+    InitPerFrameJacobian();
+}
+
 template <class TriMeshType>
 typename TriMeshType::ScalarType AnimationManager<TriMeshType>::MaxAnisotropy()
 {
+    EnsureCurvature();
     return percentileAnis;
 }
 
 template <class TriMeshType>
 typename TriMeshType::ScalarType AnimationManager<TriMeshType>::MaxStretchCompress()
 {
+    EnsureStretch();
     return percentileStretchCompress;
 }
 
@@ -547,74 +649,86 @@ void AnimationManager<TriMeshType>::ColorByStretch()
 template <class TriMeshType>
 bool AnimationManager<TriMeshType>::LoadPosFrames(const std::string &path)
 {
-    FILE *f=fopen(path.c_str(),"rt");
-    if (f==NULL)return false;
-
-    int NumFrames;
-    fscanf(f,"%d\n",&NumFrames);
-    std::cout<<"There are Frames:"<<NumFrames<<std::endl;
+    //binary caches are mapped and read lazily, text files parsed in memory
+    bool Loaded;
+    if (FrameCache::IsBinary(path))
+        Loaded=PerFramePos.OpenBinary(path);
+    else
+        Loaded=PerFramePos.LoadText(path,animated_template_shape.vert.size());
+    if (!Loaded)return false;
+    if (PerFramePos.NumVerts()!=animated_template_shape.vert.size())
+    {
+        std::cout<<"Frames have "<<PerFramePos.NumVerts()<<" vertices, mesh has "
+                 <<animated_template_shape.vert.size()<<std::endl;
+        PerFramePos.Clear();
+        return false;
+    }
+    std::cout<<"There are Frames:"<<PerFramePos.NumFrames()<<std::endl;
+
+    //the per frame curvature and jacobian are computed the first time they
+    //are needed (EnsureCurvature, EnsureStretch), the frames are not read here
+    PerFrameNormVect.Clear();
+    PerFrameCurvVect.Clear();
+    PerFrameCurvAnis.Clear();
+    JU.Clear();
+    JV.Clear();
+    return true;
+}
 
-    PerFramePos.clear();
-    PerFramePos.resize(NumFrames);
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::UpdateTemplateIndex()
+{
+    //the cached projections refer to the old template
+    if (TemplateIndex.Update(animated_template_shape))
+        MeshBasis.clear();
+}
 
-    for (size_t i=0;i<PerFramePos.size();i++)
+template <class TriMeshType>
+const ProjectionBasis<typename TriMeshType::CoordType> &AnimationManager<TriMeshType>::GetVertBasis(const TriMeshType &target)
+{
+    UpdateTemplateIndex();
+    ProjectionBasis<CoordType> &Basis=MeshBasis[&target];
+    if (ProjectionIndex<TriMeshType>::SamePositions(target,Basis.Pos))
+        return Basis;
+
+    //the one of target_shape is already there
+    if ((&target==&target_shape)&&
+        (ProjectionIndex<TriMeshType>::SamePositions(target,VertFacePos)))
     {
-        for (size_t j=0;j<animated_template_shape.vert.size();j++)
-        {
-            float XPos,YPos,ZPos;
-            fscanf(f,"%f,%f,%f\n",&XPos,&YPos,&ZPos);
-            PerFramePos[i].push_back(CoordType((ScalarType)XPos,(ScalarType)YPos,(ScalarType)ZPos));
-        }
+        Basis.Pos=VertFacePos;
+        Basis.FaceIdx=VertFaceIdx;
+        Basis.Bary=VertFaceBary;
+        return Basis;
     }
-    fclose(f);
 
-    std::cout<<"Initializing Per Frame Curvature"<<std::endl;
-    InitPerFrameCurvature();
-    std::cout<<"Done"<<std::endl;
-    std::cout<<"Initializing Per Frame Jacobian"<<std::endl;
-    InitPerFrameJacobian();
-    std::cout<<"Done"<<std::endl;
-    return true;
+    std::vector<CoordType> Points(target.vert.size());
+    for (size_t i=0;i<target.vert.size();i++)
+        Points[i]=target.vert[i].cP();
+    TemplateIndex.Project(Points,Basis);
+    return Basis;
 }
 
 template <class TriMeshType>
 void AnimationManager<TriMeshType>::UpdateProjectionBasis()
 {
-    vcg::GridStaticPtr<FaceType,ScalarType> Grid;
-    Grid.Set(animated_template_shape.face.begin(),animated_template_shape.face.end());
-
-    ScalarType MaxD=animated_template_shape.bbox.Diag();
+    UpdateTemplateIndex();
 
-    VertFaceIdx.clear();
-    VertFaceBary.clear();
+    std::vector<CoordType> Points(target_shape.vert.size());
     for (size_t i=0;i<target_shape.vert.size();i++)
-    {
-        ScalarType MinD;
-        CoordType closestPt,normI,baryP;
-        FaceType *f=vcg::tri::GetClosestFaceBase(animated_template_shape,Grid,target_shape.vert[i].P(),
-                                                 MaxD,MinD,closestPt,normI,baryP);
-        assert(f!=NULL);
-        size_t IndexF=vcg::tri::Index(animated_template_shape,f);
-
-        VertFaceIdx.push_back(IndexF);
-        VertFaceBary.push_back(baryP);
-    }
-
-    FaceFaceIdx.clear();
+        Points[i]=target_shape.vert[i].P();
+    ProjectionBasis<CoordType> Basis;
+    TemplateIndex.Project(Points,Basis);
+    VertFacePos.swap(Basis.Pos);
+    VertFaceIdx.swap(Basis.FaceIdx);
+    VertFaceBary.swap(Basis.Bary);
+
+    Points.resize(target_shape.face.size());
     for (size_t i=0;i<target_shape.face.size();i++)
-    {
-        CoordType BaryF=(target_shape.face[i].P(0)+
-                         target_shape.face[i].P(1)+
-                         target_shape.face[i].P(2))/3;
-        ScalarType MinD;
-        CoordType closestPt,normI,baryP;
-        FaceType *f=vcg::tri::GetClosestFaceBase(animated_template_shape,Grid,BaryF,
-                                                 MaxD,MinD,closestPt,normI,baryP);
-        assert(f!=NULL);
-        size_t IndexF=vcg::tri::Index(animated_template_shape,f);
-
-        FaceFaceIdx.push_back(IndexF);
-    }
+        Points[i]=(target_shape.face[i].P(0)+
+                   target_shape.face[i].P(1)+
+                   target_shape.face[i].P(2))/3;
+    TemplateIndex.Project(Points,Basis);
+    FaceFaceIdx.swap(Basis.FaceIdx);
 }
 
 template <class TriMeshType>
@@ -624,10 +738,13 @@ void AnimationManager<TriMeshType>::Init()
     vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(animated_template_shape,target_shape);
     animated_template_shape.InitRPos();
     animated_template_shape.UpdateAttributes();
+    TemplateIndex.Invalidate();
+    MeshBasis.clear();
 
     VertFaceIdx.clear();
     VertFaceBary.clear();
-    PerFramePos.clear();
+    VertFacePos.clear();
+    PerFramePos.Clear();
     UpdateProjectionBasis();
 }
 
@@ -666,15 +783,19 @@ void AnimationManager<TriMeshType>::Init()
 
 template <class TriMeshType>
 size_t AnimationManager<TriMeshType>::NumFrames()const
-{return PerFramePos.size();}
+{return PerFramePos.NumFrames();}
+
+template <class TriMeshType>
+const FrameCache &AnimationManager<TriMeshType>::PosFrames()const
+{return PerFramePos;}
 
 template <class TriMeshType>
 void AnimationManager<TriMeshType>::UpdateToFrame(size_t IndexFrame,
                                                   bool UpdateCurvature,
                                                   bool UpdateStretch)
 {
-    assert(IndexFrame<PerFramePos.size());
-    assert(PerFramePos[IndexFrame].size()==animated_template_shape.vert.size());
+    assert(IndexFrame<PerFramePos.NumFrames());
+    assert(PerFramePos.NumVerts()==animated_template_shape.vert.size());
 
     //target_shape.RestoreRPos();
     CoordType CenterTemplate=animated_template_shape.bbox.Center();
@@ -701,6 +822,7 @@ void AnimationManager<TriMeshType>::InitTargetDirectionsMax()
 {
     TargetVect.clear();
     TargetAnis.clear();
+    EnsureCurvature();
 
     assert(PerFrameCurvAnis.size()>0);
     assert(PerFrameCurvAnis.size()==PerFrameCurvVect.size());
@@ -728,12 +850,14 @@ template <class TriMeshType>
 void AnimationManager<TriMeshType>::NormalizeVect(std::vector<ScalarType>  &Values,
                                                   ScalarType cut_perc)
 {
+    //only two ranks are needed, no need to sort everything
     std::vector<ScalarType>  Test=Values;
-    std::sort(Test.begin(),Test.end());
     size_t minI=Test.size()*cut_perc;
     size_t maxI=Test.size()*(1-cut_perc);
-    ScalarType MinV= Test[minI];
+    std::nth_element(Test.begin(),Test.begin()+maxI,Test.end());
     ScalarType MaxV= Test[maxI];
+    std::nth_element(Test.begin(),Test.begin()+minI,Test.begin()+maxI);
+    ScalarType MinV= Test[minI];
 
     for (size_t i=0;i<Values.size();i++)
     {
@@ -753,6 +877,7 @@ void AnimationManager<TriMeshType>::InitTargetDirectionsAvg()
 {
     TargetVect.clear();
     TargetAnis.clear();
+    EnsureCurvature();
 
     assert(PerFrameCurvAnis.size()>0);
     assert(PerFrameCurvAnis.size()==PerFrameCurvVect.size());
@@ -809,7 +934,7 @@ void AnimationManager<TriMeshType>::InitTargetDirectionsAvg()
 }
 
 template <class TriMeshType>
-void AnimationManager<TriMeshType>::UpdateAnimationMesh()
+void AnimationManager<TriMeshType>::UpdateAnimationMesh(int Needed)
 {
     //initial check
     for (size_t i=0;i<PerFrameCurvAnis.size();i++)
@@ -822,49 +947,124 @@ void AnimationManager<TriMeshType>::UpdateAnimationMesh()
     //update projection basis
     UpdateProjectionBasis();
 
-    //allocate
-    std::vector<std::vector<CoordType> > PerFrameNormVect1;
-    std::vector<std::vector<CoordType> > PerFrameCurvVect1;
-    std::vector<std::vector<ScalarType> > PerFrameCurvAnis1;
-    std::vector<std::vector<CoordType> > JU1,JV1;
-    PerFrameNormVect1.resize(NumFrames(),std::vector<CoordType>(target_shape.face.size(),CoordType(0,0,0)));
-    PerFrameCurvVect1.resize(NumFrames(),std::vector<CoordType>(target_shape.face.size(),CoordType(0,0,0)));
-    PerFrameCurvAnis1.resize(NumFrames(),std::vector<ScalarType>(target_shape.face.size(),0));
-    JU1.resize(NumFrames(),std::vector<CoordType>(target_shape.face.size(),CoordType(0,0,0)));
-    JV1.resize(NumFrames(),std::vector<CoordType>(target_shape.face.size(),CoordType(0,0,0)));
+    //the needed data is computed on the original template before it is
+    //replaced, as the jacobians depend on its rest positions
+    bool DoCurvature=((Needed & ADCurvature)!=0);
+    bool DoStretch=((Needed & ADStretch)!=0);
+    if (DoCurvature)EnsureCurvature();
+    if (DoStretch)EnsureStretch();
+    DoCurvature&=(PerFrameCurvAnis.size()==NumFrames());
+    DoStretch&=(JU.size()==NumFrames());
+    if (!DoCurvature)
+    {
+        PerFrameNormVect.Clear();
+        PerFrameCurvVect.Clear();
+        PerFrameCurvAnis.Clear();
+    }
+    if (!DoStretch)
+    {
+        JU.Clear();
+        JV.Clear();
+    }
 
-    std::vector<std::vector<CoordType> > PerFramePos1;
-    PerFramePos1.resize(NumFrames(),std::vector<CoordType>(target_shape.vert.size(),CoordType(0,0,0)));
+    FrameCache PerFramePos1;
+    float *NewPos=PerFramePos1.Allocate(NumFrames(),target_shape.vert.size());
+
+    //the new data is written in separate stores, swapped at the end;
+    //they are filled one slab of frames at a time and the matching slab of
+    //the old data is released right after (the interpolation of frame i
+    //only reads frame i), so the peak is the old data plus one slab
+    size_t NumF=target_shape.face.size();
+    FrameVectorField<CoordType> PerFrameNormVect1(true),PerFrameCurvVect1,JU1,JV1;
+    FrameScalarField<ScalarType> PerFrameCurvAnis1;
+    if (DoCurvature)
+    {
+        PerFrameNormVect1.Allocate(NumFrames(),NumF,field_precision,false);
+        PerFrameCurvVect1.Allocate(NumFrames(),NumF,field_precision,false);
+        PerFrameCurvAnis1.Allocate(NumFrames(),NumF,field_precision,false);
+    }
+    if (DoStretch)
+    {
+        JU1.Allocate(NumFrames(),NumF,field_precision,false);
+        JV1.Allocate(NumFrames(),NumF,field_precision,false);
+    }
 
-    //then update the new
-    for (size_t i=0;i<NumFrames();i++)
+    size_t NumSlabs=(NumFrames()+FRAME_SLAB_SIZE-1)/FRAME_SLAB_SIZE;
+    for (size_t s=0;s<NumSlabs;s++)
     {
-        for (size_t j=0;j<target_shape.face.size();j++)
+        size_t FirstFrame=s*FRAME_SLAB_SIZE;
+        size_t SlabFrames=std::min((size_t)FRAME_SLAB_SIZE,NumFrames()-FirstFrame);
+        if (DoCurvature)
+        {
+            PerFrameNormVect1.AllocateSlab(s);
+            PerFrameCurvVect1.AllocateSlab(s);
+            PerFrameCurvAnis1.AllocateSlab(s);
+        }
+        if (DoStretch)
+        {
+            JU1.AllocateSlab(s);
+            JV1.AllocateSlab(s);
+        }
+
+        ParallelFor(SlabFrames,frame_threads,[&](size_t k)
+        {
+            size_t i=FirstFrame+k;
+            for (size_t j=0;(j<NumF)&&DoCurvature;j++)
+            {
+                CoordType NormVect,CurvVect;
+                ScalarType CurvAnis;
+                InterpolateFaceNorm(j,i,NormVect);
+                InterpolateFaceField(j,i,CurvVect,CurvAnis);
+                PerFrameNormVect1.Set(i,j,NormVect);
+                PerFrameCurvVect1.Set(i,j,CurvVect);
+                PerFrameCurvAnis1.Set(i,j,CurvAnis);
+            }
+            for (size_t j=0;(j<NumF)&&DoStretch;j++)
+            {
+                CoordType FaceJU,FaceJV;
+                InterpolateFaceStretch(j,i,FaceJU,FaceJV);
+                JU1.Set(i,j,FaceJU);
+                JV1.Set(i,j,FaceJV);
+            }
+            for (size_t j=0;j<target_shape.vert.size();j++)
+            {
+                CoordType Pos=InterpolatePos(j,i);
+                float *Dest=NewPos+(i*target_shape.vert.size()+j)*3;
+                Dest[0]=Pos.X();
+                Dest[1]=Pos.Y();
+                Dest[2]=Pos.Z();
+            }
+        });
+
+        if (DoCurvature)
         {
-            InterpolateFaceNorm(j,i,PerFrameNormVect1[i][j]);
-            InterpolateFaceField(j,i,PerFrameCurvVect1[i][j],PerFrameCurvAnis1[i][j]);
-            //CoordType test=PerFrameCurvVect1[i][j];
-            InterpolateFaceStretch(j,i,JU1[i][j],JV1[i][j]);
+            PerFrameNormVect.ReleaseSlab(s);
+            PerFrameCurvVect.ReleaseSlab(s);
+            PerFrameCurvAnis.ReleaseSlab(s);
         }
-        for (size_t j=0;j<target_shape.vert.size();j++)
+        if (DoStretch)
         {
-            PerFramePos1[i][j]=InterpolatePos(j,i);
+            JU.ReleaseSlab(s);
+            JV.ReleaseSlab(s);
         }
     }
 
-    //then substitute vectors
-    PerFrameNormVect=PerFrameNormVect1;
-    PerFrameCurvVect=PerFrameCurvVect1;
-    PerFrameCurvAnis=PerFrameCurvAnis1;
-    PerFramePos=PerFramePos1;
-    JU=JU1;
-    JV=JV1;
+    //then substitute the positions and the per frame data
+    PerFramePos.Swap(PerFramePos1);
+    PerFramePos1.Clear();
+    PerFrameNormVect.Swap(PerFrameNormVect1);
+    PerFrameCurvVect.Swap(PerFrameCurvVect1);
+    PerFrameCurvAnis.Swap(PerFrameCurvAnis1);
+    JU.Swap(JU1);
+    JV.Swap(JV1);
 
     //update the mesh
     animated_template_shape.Clear();
     vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(animated_template_shape,target_shape);
     animated_template_shape.InitRPos();
     animated_template_shape.UpdateAttributes();
+    TemplateIndex.Invalidate();
+    MeshBasis.clear();
 
     //update the interpolartion bases
     UpdateProjectionBasis();
@@ -901,18 +1101,17 @@ void AnimationManager<TriMeshType>::InitTargetDirectionsOnMesh()
 template <class TriMeshType>
 void AnimationManager<TriMeshType>::TransferDirOnMesh(TriMeshType &target)
 {
-    vcg::GridStaticPtr<FaceType,ScalarType> Grid;
-    Grid.Set(target_shape.face.begin(),target_shape.face.end());
-    ScalarType MaxD=target_shape.bbox.Diag();
+    TargetIndex.Update(target_shape);
+
+    std::vector<CoordType> Points(target.face.size());
+    for (size_t i=0;i<target.face.size();i++)
+        Points[i]=(target.face[i].P(0)+target.face[i].P(1)+target.face[i].P(2))/3;
+    ProjectionBasis<CoordType> Basis;
+    TargetIndex.Project(Points,Basis);
 
     for (size_t i=0;i<target.face.size();i++)
     {
-        ScalarType MinD;
-        CoordType closestPt,normI,baryP;
-        CoordType BaryF=(target.face[i].P(0)+target.face[i].P(1)+target.face[i].P(2))/3;
-        FaceType *f=vcg::tri::GetClosestFaceBase(target_shape,Grid,BaryF,
-                                                 MaxD,MinD,closestPt,normI,baryP);
-        assert(f!=NULL);
+        const FaceType *f=&target_shape.face[Basis.FaceIdx[i]];
         target.face[i].PD1()=f->PD1();
         target.face[i].PD2()=f->PD2();
         target.face[i].Q()=f->Q();
@@ -925,40 +1124,109 @@ void AnimationManager<TriMeshType>::InterpolatePosOnMesh(TriMeshType &target,siz
 {
     VertPos.clear();
 
-    vcg::GridStaticPtr<FaceType,ScalarType> Grid;
-    Grid.Set(animated_template_shape.face.begin(),animated_template_shape.face.end());
-    ScalarType MaxD=animated_template_shape.bbox.Diag();
-
-    assert(IndexFrame<PerFramePos.size());
+    assert(IndexFrame<PerFramePos.NumFrames());
+    const ProjectionBasis<CoordType> &Basis=GetVertBasis(target);
     for (size_t i=0;i<target.vert.size();i++)
     {
-        ScalarType MinD;
-        CoordType closestPt,normI,baryP;
-        FaceType *f=vcg::tri::GetClosestFaceBase(animated_template_shape,Grid,
-                                                 target.vert[i].P(),
-                                                 MaxD,MinD,closestPt,normI,baryP);
-
-        size_t IndexV0=vcg::tri::Index(animated_template_shape,f->V(0));
-        size_t IndexV1=vcg::tri::Index(animated_template_shape,f->V(1));
-        size_t IndexV2=vcg::tri::Index(animated_template_shape,f->V(2));
+        const FaceType *f=&animated_template_shape.face[Basis.FaceIdx[i]];
+        const CoordType &baryP=Basis.Bary[i];
 
-        assert(IndexV0<PerFramePos[IndexFrame].size());
-        assert(IndexV1<PerFramePos[IndexFrame].size());
-        assert(IndexV2<PerFramePos[IndexFrame].size());
+        size_t IndexV0=vcg::tri::Index(animated_template_shape,f->cV(0));
+        size_t IndexV1=vcg::tri::Index(animated_template_shape,f->cV(1));
+        size_t IndexV2=vcg::tri::Index(animated_template_shape,f->cV(2));
 
-        CoordType P0=PerFramePos[IndexFrame][IndexV0];
-        CoordType P1=PerFramePos[IndexFrame][IndexV1];
-        CoordType P2=PerFramePos[IndexFrame][IndexV2];
+        CoordType P0=FramePos(IndexFrame,IndexV0);
+        CoordType P1=FramePos(IndexFrame,IndexV1);
+        CoordType P2=FramePos(IndexFrame,IndexV2);
 
         CoordType Interp = P0*baryP.X()+P1*baryP.Y()+P2*baryP.Z();
         VertPos.push_back(Interp);
     }
 }
 
+template <class TriMeshType>
+void AnimationManager<TriMeshType>::SelectFrames(FrameSelection Mode,size_t Budget,
+                                                 std::vector<size_t> &Frames)
+{
+    Frames.clear();
+    size_t NumF=NumFrames();
+    if ((Budget==0)||(NumF==0))return;
+    if (Budget>=NumF)
+    {
+        for (size_t i=0;i<NumF;i++)
+            Frames.push_back(i);
+        return;
+    }
+
+    if (Mode==FSUniform)
+    {
+        for (size_t i=0;i<Budget;i++)
+            Frames.push_back((2*i+1)*NumF/(2*Budget));
+        return;
+    }
+
+    if (Mode==FSMaxStretch)
+    {
+        //average stretch or compression of the faces in each frame
+        EnsureStretch();
+        std::vector<ScalarType> Score(NumF,0);
+        ParallelFor(NumF,frame_threads,[&](size_t i)
+        {
+            for (size_t j=0;j<JU[i].size();j++)
+            {
+                ScalarType KValU=getKForStretchCompression(JU[i][j]);
+                ScalarType KValV=getKForStretchCompression(JV[i][j]);
+                Score[i]+=std::max(fabs(KValU),fabs(KValV));
+            }
+        });
+        std::vector<size_t> Order(NumF);
+        for (size_t i=0;i<NumF;i++)
+            Order[i]=i;
+        std::partial_sort(Order.begin(),Order.begin()+Budget,Order.end(),
+                          [&](size_t F0,size_t F1){return Score[F0]>Score[F1];});
+        Frames.assign(Order.begin(),Order.begin()+Budget);
+        std::sort(Frames.begin(),Frames.end());
+        return;
+    }
+
+    assert(Mode==FSCluster);
+    //squared distance of each frame from the closest pose selected so far
+    size_t NumV=PerFramePos.NumVerts();
+    assert(NumV==animated_template_shape.vert.size());
+    std::vector<ScalarType> MinDist(NumF);
+    ParallelFor(NumF,frame_threads,[&](size_t i)
+    {
+        ScalarType Dist=0;
+        for (size_t j=0;j<NumV;j++)
+            Dist+=(FramePos(i,j)-animated_template_shape.vert[j].RPos).SquaredNorm();
+        MinDist[i]=Dist;
+    });
+    for (size_t s=0;s<Budget;s++)
+    {
+        size_t Farthest=std::max_element(MinDist.begin(),MinDist.end())-MinDist.begin();
+        //all the remaining frames are the rest pose or an already chosen one
+        if (MinDist[Farthest]<=0)break;
+        Frames.push_back(Farthest);
+        const float *PosF=PerFramePos.Frame(Farthest);
+        ParallelFor(NumF,frame_threads,[&](size_t i)
+        {
+            if (MinDist[i]==0)return;
+            const float *PosI=PerFramePos.Frame(i);
+            ScalarType Dist=0;
+            for (size_t j=0;j<NumV*3;j++)
+                Dist+=(PosI[j]-PosF[j])*(PosI[j]-PosF[j]);
+            MinDist[i]=std::min(MinDist[i],Dist);
+        });
+        MinDist[Farthest]=0;
+    }
+    std::sort(Frames.begin(),Frames.end());
+}
+
 template <class TriMeshType>
 void AnimationManager<TriMeshType>::InterpolateMultipleFramesOnMesh(TriMeshType &target,
-                                                                    size_t FrameInterval,
+                                                                    size_t Budget,
                                                                     std::vector<std::vector<CoordType> > &VertPos,
+                                                                    FrameSelection Mode,
                                                                     bool add_rest)
 {
 
@@ -970,22 +1238,30 @@ void AnimationManager<TriMeshType>::InterpolateMultipleFramesOnMesh(TriMeshType
             VertPos[0].push_back(target.vert[i].P());
     }
 
-    if (FrameInterval==0)return;
+    std::vector<size_t> Frames;
+    SelectFrames(Mode,Budget,Frames);
+    if (Frames.size()>0)
+    {
+        std::cout<<"Selected Frames:";
+        for (size_t i=0;i<Frames.size();i++)
+            std::cout<<" "<<Frames[i];
+        std::cout<<std::endl;
+    }
 
-    VertPos.resize(VertPos.size()+1);
-    InterpolatePosOnMesh(target,5,VertPos.back());
-//    size_t IntFrame=floor(0.5+NumFrames()/FrameInterval);
-//    IntFrame=std::max(IntFrame,(size_t)1);
-//    for (size_t i=0;i<NumFrames();i+=IntFrame)
-//    {
-//        VertPos.resize(VertPos.size()+1);
-//        InterpolatePosOnMesh(target,i,VertPos.back());
-//    }
+    for (size_t i=0;i<Frames.size();i++)
+    {
+        VertPos.resize(VertPos.size()+1);
+        InterpolatePosOnMesh(target,Frames[i],VertPos.back());
+    }
 }
 
 template <class TriMeshType>
-AnimationManager<TriMeshType>::AnimationManager(TriMeshType &_target_shape):target_shape(_target_shape)
-{}
+AnimationManager<TriMeshType>::AnimationManager(TriMeshType &_target_shape):target_shape(_target_shape),
+    PerFrameNormVect(true)
+{
+    frame_threads=0;
+    field_precision=FPDouble;
+}
 
 ////Manual instantiation:
 template class Jacobian<TraceFace>;
@@ -123,7 +123,9 @@ void FieldComputation<TriMeshType>::ComputeField(TriMeshType &mesh,
         else
         {
 
-            AManag.UpdateAnimationMesh();
+            //the stretch is carried over too, so it keeps being measured
+            //from the rest positions of the original template
+            AManag.UpdateAnimationMesh(ADAll);
             //AManag.UpdateProjectionBasis();
             AManag.InitTargetDirectionsOnMesh();
             AManag.TransferDirOnMesh(mesh);
@@ -0,0 +1,270 @@
+#ifndef PARAFASHION_FRAME_CACHE
+#define PARAFASHION_FRAME_CACHE
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define FRAME_CACHE_MMAP
+#endif
+
+//binary layout: magic, version, number of frames, number of vertices
+//(uint32 each) then the frames one after the other, each one made of
+//x,y,z float32 per vertex; the header is 16 bytes so the frames are aligned
+#define FRAME_CACHE_MAGIC "PFFR"
+#define FRAME_CACHE_VERSION 1
+#define FRAME_CACHE_HEADER 16
+
+//per frame per vertex positions, either memory mapped from a binary cache
+//(pages are read by the OS only when a frame is accessed) or stored in memory
+//(when loaded from the text format or rebuilt on a new mesh)
+class FrameCache
+{
+    const float *Data;
+    size_t NFrames;
+    size_t NVerts;
+
+    void *Mapped;
+    size_t MappedSize;
+
+    std::vector<float> Owned;
+
+    FrameCache(const FrameCache &);
+    FrameCache &operator=(const FrameCache &);
+
+    static bool ReadHeader(FILE *f,uint32_t &NumFrames,uint32_t &NumVerts)
+    {
+        char Magic[4];
+        uint32_t Version;
+        if (fread(Magic,1,4,f)!=4)return false;
+        if (memcmp(Magic,FRAME_CACHE_MAGIC,4)!=0)return false;
+        if (fread(&Version,sizeof(uint32_t),1,f)!=1)return false;
+        if (Version!=FRAME_CACHE_VERSION)return false;
+        if (fread(&NumFrames,sizeof(uint32_t),1,f)!=1)return false;
+        if (fread(&NumVerts,sizeof(uint32_t),1,f)!=1)return false;
+        return true;
+    }
+
+    static void WriteHeader(FILE *f,uint32_t NumFrames,uint32_t NumVerts)
+    {
+        uint32_t Version=FRAME_CACHE_VERSION;
+        fwrite(FRAME_CACHE_MAGIC,1,4,f);
+        fwrite(&Version,sizeof(uint32_t),1,f);
+        fwrite(&NumFrames,sizeof(uint32_t),1,f);
+        fwrite(&NumVerts,sizeof(uint32_t),1,f);
+    }
+
+    //parse the next number of the text format, skipping separators
+    static bool NextFloat(const char *&Curr,const char *End,float &Val)
+    {
+        while ((Curr<End)&&((*Curr==',')||(*Curr==' ')||(*Curr=='\t')||
+                            (*Curr=='\n')||(*Curr=='\r')))
+            Curr++;
+        if (Curr>=End)return false;
+        char *Next;
+        Val=strtof(Curr,&Next);
+        if (Next==Curr)return false;
+        Curr=Next;
+        return true;
+    }
+
+    static bool ReadWholeFile(const std::string &path,std::vector<char> &Text)
+    {
+        FILE *f=fopen(path.c_str(),"rb");
+        if (f==NULL)return false;
+        fseek(f,0,SEEK_END);
+        long Size=ftell(f);
+        fseek(f,0,SEEK_SET);
+        if (Size<0){fclose(f);return false;}
+        //terminated so strtof never reads past the buffer
+        Text.resize(Size+1);
+        bool Ok=(fread(Text.data(),1,Size,f)==(size_t)Size);
+        Text[Size]=0;
+        fclose(f);
+        return Ok;
+    }
+
+public:
+
+    size_t NumFrames()const{return NFrames;}
+
+    size_t NumVerts()const{return NVerts;}
+
+    //x,y,z of the vertices of a frame
+    const float *Frame(size_t IndexFrame)const
+    {
+        return Data+IndexFrame*NVerts*3;
+    }
+
+    const float *Vert(size_t IndexFrame,size_t IndexV)const
+    {
+        return Data+(IndexFrame*NVerts+IndexV)*3;
+    }
+
+    void Clear()
+    {
+#ifdef FRAME_CACHE_MMAP
+        if (Mapped!=NULL)
+            munmap(Mapped,MappedSize);
+#endif
+        Mapped=NULL;
+        MappedSize=0;
+        Owned.clear();
+        Owned.shrink_to_fit();
+        Data=NULL;
+        NFrames=0;
+        NVerts=0;
+    }
+
+    //in memory frames to be filled by the caller
+    float *Allocate(size_t NumFrames,size_t NumVerts)
+    {
+        Clear();
+        Owned.resize(NumFrames*NumVerts*3,0);
+        NFrames=NumFrames;
+        NVerts=NumVerts;
+        Data=Owned.data();
+        return Owned.data();
+    }
+
+    void Swap(FrameCache &Other)
+    {
+        std::swap(Data,Other.Data);
+        std::swap(NFrames,Other.NFrames);
+        std::swap(NVerts,Other.NVerts);
+        std::swap(Mapped,Other.Mapped);
+        std::swap(MappedSize,Other.MappedSize);
+        Owned.swap(Other.Owned);
+    }
+
+    static bool IsBinary(const std::string &path)
+    {
+        FILE *f=fopen(path.c_str(),"rb");
+        if (f==NULL)return false;
+        uint32_t NumFrames,NumVerts;
+        bool Ok=ReadHeader(f,NumFrames,NumVerts);
+        fclose(f);
+        return Ok;
+    }
+
+    //map a binary cache, without reading the frames
+    bool OpenBinary(const std::string &path)
+    {
+        Clear();
+        FILE *f=fopen(path.c_str(),"rb");
+        if (f==NULL)return false;
+        uint32_t NumFrames,NumVerts;
+        bool Ok=ReadHeader(f,NumFrames,NumVerts);
+        fseek(f,0,SEEK_END);
+        long Size=ftell(f);
+        size_t Expected=FRAME_CACHE_HEADER+(size_t)NumFrames*NumVerts*3*sizeof(float);
+        Ok=Ok&&(Size>=0)&&((size_t)Size>=Expected);
+#ifdef FRAME_CACHE_MMAP
+        fclose(f);
+        if (!Ok)return false;
+        int fd=open(path.c_str(),O_RDONLY);
+        if (fd<0)return false;
+        void *Ptr=mmap(NULL,Expected,PROT_READ,MAP_SHARED,fd,0);
+        //the mapping stays valid after closing the descriptor
+        close(fd);
+        if (Ptr==MAP_FAILED)return false;
+        Mapped=Ptr;
+        MappedSize=Expected;
+        Data=(const float*)((const char*)Ptr+FRAME_CACHE_HEADER);
+        NFrames=NumFrames;
+        NVerts=NumVerts;
+        return true;
+#else
+        //no mmap, read everything
+        if (!Ok){fclose(f);return false;}
+        fseek(f,FRAME_CACHE_HEADER,SEEK_SET);
+        float *Dest=Allocate(NumFrames,NumVerts);
+        Ok=(fread(Dest,sizeof(float),Owned.size(),f)==Owned.size());
+        fclose(f);
+        if (!Ok)Clear();
+        return Ok;
+#endif
+    }
+
+    //text format: number of frames, then one "x,y,z" line per vertex per frame
+    bool LoadText(const std::string &path,size_t NumVerts)
+    {
+        Clear();
+        std::vector<char> Text;
+        if (!ReadWholeFile(path,Text))return false;
+        const char *Curr=Text.data();
+        const char *End=Text.data()+Text.size()-1;
+        char *Next;
+        long NumFrames=strtol(Curr,&Next,10);
+        if ((Next==Curr)||(NumFrames<0))return false;
+        Curr=Next;
+
+        float *Dest=Allocate(NumFrames,NumVerts);
+        for (size_t i=0;i<Owned.size();i++)
+            if (!NextFloat(Curr,End,Dest[i]))
+            {
+                Clear();
+                return false;
+            }
+        return true;
+    }
+
+    bool SaveBinary(const std::string &path)const
+    {
+        FILE *f=fopen(path.c_str(),"wb");
+        if (f==NULL)return false;
+        WriteHeader(f,(uint32_t)NFrames,(uint32_t)NVerts);
+        fwrite(Data,sizeof(float),NFrames*NVerts*3,f);
+        bool Ok=(ferror(f)==0);
+        fclose(f);
+        return Ok;
+    }
+
+    //convert the text format to the binary cache; the number of vertices is
+    //deduced from the number of values
+    static bool ConvertText(const std::string &pathText,
+                            const std::string &pathBinary)
+    {
+        std::vector<char> Text;
+        if (!ReadWholeFile(pathText,Text))return false;
+        const char *Curr=Text.data();
+        const char *End=Text.data()+Text.size()-1;
+        char *Next;
+        long NumFrames=strtol(Curr,&Next,10);
+        if ((Next==Curr)||(NumFrames<=0))return false;
+        Curr=Next;
+
+        FILE *f=fopen(pathBinary.c_str(),"wb");
+        if (f==NULL)return false;
+        WriteHeader(f,(uint32_t)NumFrames,0);
+        size_t NumVal=0;
+        float Val;
+        while (NextFloat(Curr,End,Val))
+        {
+            fwrite(&Val,sizeof(float),1,f);
+            NumVal++;
+        }
+        bool Ok=(NumVal%(NumFrames*3)==0);
+        uint32_t NumVerts=NumVal/(NumFrames*3);
+        fseek(f,12,SEEK_SET);
+        fwrite(&NumVerts,sizeof(uint32_t),1,f);
+        Ok=Ok&&(ferror(f)==0);
+        fclose(f);
+        return Ok;
+    }
+
+    FrameCache():Data(NULL),NFrames(0),NVerts(0),Mapped(NULL),MappedSize(0){}
+
+    ~FrameCache(){Clear();}
+};
+
+#endif
@@ -0,0 +1,413 @@
+#ifndef FRAME_FIELD_STORE
+#define FRAME_FIELD_STORE
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <utility>
+
+//precision of the per frame per face data of the animation:
+//double, float, or quantized (unit vectors as two 16 bit octahedral
+//coordinates, lengths and scalars as 16 bit half floats)
+enum FieldPrecision{FPDouble,FPFloat,FPQuantized};
+
+inline uint16_t FloatToHalf(float Val)
+{
+    uint32_t Bits;
+    memcpy(&Bits,&Val,sizeof(float));
+    uint32_t Sign=(Bits>>16)&0x8000;
+    int32_t Exp=(int32_t)((Bits>>23)&0xff)-127+15;
+    uint32_t Mant=Bits&0x7fffff;
+    //nan and inf
+    if (((Bits>>23)&0xff)==0xff)
+        return (uint16_t)(Sign|0x7c00|(Mant?0x200:0));
+    //too large, too small
+    if (Exp>=31)return (uint16_t)(Sign|0x7c00);
+    if (Exp<-10)return (uint16_t)Sign;
+    //subnormal
+    if (Exp<=0)
+    {
+        Mant|=0x800000;
+        uint32_t Shift=14-Exp;
+        uint32_t Half=Sign|(Mant>>Shift);
+        if (Mant&(1u<<(Shift-1)))Half++;
+        return (uint16_t)Half;
+    }
+    //round to nearest
+    uint32_t Half=Sign|((uint32_t)Exp<<10)|(Mant>>13);
+    if (Mant&0x1000)Half++;
+    return (uint16_t)Half;
+}
+
+inline float HalfToFloat(uint16_t Half)
+{
+    uint32_t Sign=(uint32_t)(Half&0x8000)<<16;
+    uint32_t Exp=(Half>>10)&0x1f;
+    uint32_t Mant=Half&0x3ff;
+    uint32_t Bits;
+    if (Exp==0)
+    {
+        //subnormal
+        float Val=std::ldexp((float)Mant,-24);
+        return (Half&0x8000)?-Val:Val;
+    }
+    if (Exp==31)
+        Bits=Sign|0x7f800000|(Mant<<13);
+    else
+        Bits=Sign|((Exp-15+127)<<23)|(Mant<<13);
+    float Val;
+    memcpy(&Val,&Bits,sizeof(float));
+    return Val;
+}
+
+inline uint16_t OctQuantize(double Val)
+{
+    double Clamped=std::min(std::max(Val,-1.0),1.0);
+    return (uint16_t)std::floor((Clamped*0.5+0.5)*65535+0.5);
+}
+
+inline double OctDequantize(uint16_t Val)
+{
+    return ((double)Val/65535)*2-1;
+}
+
+//octahedral encoding of the direction of a non null vector
+inline void OctEncode(double X,double Y,double Z,uint16_t &U,uint16_t &V)
+{
+    double Sum=std::fabs(X)+std::fabs(Y)+std::fabs(Z);
+    if (Sum==0){U=OctQuantize(0);V=OctQuantize(0);return;}
+    X/=Sum;Y/=Sum;Z/=Sum;
+    if (Z<0)
+    {
+        double OX=X;
+        X=(1-std::fabs(Y))*((OX>=0)?1:-1);
+        Y=(1-std::fabs(OX))*((Y>=0)?1:-1);
+    }
+    U=OctQuantize(X);
+    V=OctQuantize(Y);
+}
+
+inline void OctDecode(uint16_t U,uint16_t V,double &X,double &Y,double &Z)
+{
+    X=OctDequantize(U);
+    Y=OctDequantize(V);
+    Z=1-std::fabs(X)-std::fabs(Y);
+    if (Z<0)
+    {
+        double OX=X;
+        X=(1-std::fabs(Y))*((OX>=0)?1:-1);
+        Y=(1-std::fabs(OX))*((Y>=0)?1:-1);
+    }
+    double Norm=std::sqrt(X*X+Y*Y+Z*Z);
+    X/=Norm;Y/=Norm;Z/=Norm;
+}
+
+//frames are stored in slabs of FRAME_SLAB_SIZE frames, each slab is one
+//contiguous frame-major block, so a store can be rebuilt slab by slab
+//without holding two complete copies
+#define FRAME_SLAB_SIZE 16
+
+//per frame per face vectors, frame-major;
+//Field[i][j] reads the vector of face j in frame i (by value)
+template <class CoordType>
+class FrameVectorField
+{
+    typedef typename CoordType::ScalarType ScalarType;
+
+    FieldPrecision Precision;
+    //unit vectors do not need their length when quantized
+    bool Unit;
+    size_t NFrames;
+    size_t NFaces;
+    std::vector<std::vector<double> > DataD;
+    std::vector<std::vector<float> > DataF;
+    std::vector<std::vector<uint16_t> > DataQ;
+
+    size_t Stride()const
+    {
+        if (Precision!=FPQuantized)return 3;
+        return Unit?2:3;
+    }
+
+    size_t Offset(size_t Frame,size_t Face)const
+    {
+        return ((Frame%FRAME_SLAB_SIZE)*NFaces+Face)*Stride();
+    }
+
+public:
+
+    class View
+    {
+        const FrameVectorField *Field;
+        size_t Frame;
+    public:
+        size_t size()const{return Field->NFaces;}
+        CoordType operator[](size_t Face)const{return Field->Get(Frame,Face);}
+        View(const FrameVectorField *_Field,size_t _Frame):Field(_Field),Frame(_Frame){}
+    };
+
+    size_t size()const{return NFrames;}
+
+    size_t NumFaces()const{return NFaces;}
+
+    size_t NumSlabs()const{return (NFrames+FRAME_SLAB_SIZE-1)/FRAME_SLAB_SIZE;}
+
+    View operator[](size_t Frame)const
+    {
+        assert(Frame<NFrames);
+        return View(this,Frame);
+    }
+
+    FieldPrecision GetPrecision()const{return Precision;}
+
+    void Clear()
+    {
+        std::vector<std::vector<double> >().swap(DataD);
+        std::vector<std::vector<float> >().swap(DataF);
+        std::vector<std::vector<uint16_t> >().swap(DataQ);
+        NFrames=0;
+        NFaces=0;
+    }
+
+    //with AllocSlabs false the slabs are allocated later with AllocateSlab
+    void Allocate(size_t NumFrames,size_t NumFaces,FieldPrecision _Precision,
+                  bool AllocSlabs=true)
+    {
+        Clear();
+        Precision=_Precision;
+        NFrames=NumFrames;
+        NFaces=NumFaces;
+        if (Precision==FPDouble)DataD.resize(NumSlabs());
+        if (Precision==FPFloat)DataF.resize(NumSlabs());
+        if (Precision==FPQuantized)DataQ.resize(NumSlabs());
+        for (size_t i=0;(i<NumSlabs())&&(AllocSlabs);i++)
+            AllocateSlab(i);
+    }
+
+    void AllocateSlab(size_t Slab)
+    {
+        assert(Slab<NumSlabs());
+        size_t SlabFrames=std::min((size_t)FRAME_SLAB_SIZE,NFrames-Slab*FRAME_SLAB_SIZE);
+        size_t Size=SlabFrames*NFaces*Stride();
+        if (Precision==FPDouble)DataD[Slab].assign(Size,0);
+        if (Precision==FPFloat)DataF[Slab].assign(Size,0);
+        if (Precision==FPQuantized)DataQ[Slab].assign(Size,0);
+    }
+
+    //the frames of the slab cannot be read anymore
+    void ReleaseSlab(size_t Slab)
+    {
+        assert(Slab<NumSlabs());
+        if (Precision==FPDouble)std::vector<double>().swap(DataD[Slab]);
+        if (Precision==FPFloat)std::vector<float>().swap(DataF[Slab]);
+        if (Precision==FPQuantized)std::vector<uint16_t>().swap(DataQ[Slab]);
+    }
+
+    void Set(size_t Frame,size_t Face,const CoordType &Val)
+    {
+        assert(Frame<NFrames);
+        assert(Face<NFaces);
+        size_t Slab=Frame/FRAME_SLAB_SIZE;
+        size_t Index=Offset(Frame,Face);
+        if (Precision==FPDouble)
+        {
+            assert(Index+3<=DataD[Slab].size());
+            for (size_t k=0;k<3;k++)
+                DataD[Slab][Index+k]=Val.V(k);
+            return;
+        }
+        if (Precision==FPFloat)
+        {
+            assert(Index+3<=DataF[Slab].size());
+            for (size_t k=0;k<3;k++)
+                DataF[Slab][Index+k]=(float)Val.V(k);
+            return;
+        }
+        std::vector<uint16_t> &Data=DataQ[Slab];
+        assert(Index+Stride()<=Data.size());
+        OctEncode(Val.X(),Val.Y(),Val.Z(),Data[Index],Data[Index+1]);
+        if (!Unit)
+            Data[Index+2]=FloatToHalf((float)Val.Norm());
+    }
+
+    CoordType Get(size_t Frame,size_t Face)const
+    {
+        assert(Frame<NFrames);
+        assert(Face<NFaces);
+        size_t Slab=Frame/FRAME_SLAB_SIZE;
+        size_t Index=Offset(Frame,Face);
+        if (Precision==FPDouble)
+        {
+            const std::vector<double> &Data=DataD[Slab];
+            assert(Index+3<=Data.size());
+            return CoordType(Data[Index],Data[Index+1],Data[Index+2]);
+        }
+        if (Precision==FPFloat)
+        {
+            const std::vector<float> &Data=DataF[Slab];
+            assert(Index+3<=Data.size());
+            return CoordType(Data[Index],Data[Index+1],Data[Index+2]);
+        }
+        const std::vector<uint16_t> &Data=DataQ[Slab];
+        assert(Index+Stride()<=Data.size());
+        double X,Y,Z;
+        OctDecode(Data[Index],Data[Index+1],X,Y,Z);
+        CoordType Dir((ScalarType)X,(ScalarType)Y,(ScalarType)Z);
+        if (Unit)return Dir;
+        return Dir*(ScalarType)HalfToFloat(Data[Index+2]);
+    }
+
+    void Swap(FrameVectorField &Other)
+    {
+        std::swap(Precision,Other.Precision);
+        std::swap(Unit,Other.Unit);
+        std::swap(NFrames,Other.NFrames);
+        std::swap(NFaces,Other.NFaces);
+        DataD.swap(Other.DataD);
+        DataF.swap(Other.DataF);
+        DataQ.swap(Other.DataQ);
+    }
+
+    size_t MemoryBytes()const
+    {
+        size_t Bytes=0;
+        for (size_t i=0;i<DataD.size();i++)Bytes+=DataD[i].size()*sizeof(double);
+        for (size_t i=0;i<DataF.size();i++)Bytes+=DataF[i].size()*sizeof(float);
+        for (size_t i=0;i<DataQ.size();i++)Bytes+=DataQ[i].size()*sizeof(uint16_t);
+        return Bytes;
+    }
+
+    FrameVectorField(bool _Unit=false):Precision(FPDouble),Unit(_Unit),NFrames(0),NFaces(0){}
+};
+
+//same as above for per frame per face scalars
+template <class ScalarType>
+class FrameScalarField
+{
+    FieldPrecision Precision;
+    size_t NFrames;
+    size_t NFaces;
+    std::vector<std::vector<double> > DataD;
+    std::vector<std::vector<float> > DataF;
+    std::vector<std::vector<uint16_t> > DataQ;
+
+    size_t Offset(size_t Frame,size_t Face)const
+    {
+        return (Frame%FRAME_SLAB_SIZE)*NFaces+Face;
+    }
+
+public:
+
+    class View
+    {
+        const FrameScalarField *Field;
+        size_t Frame;
+    public:
+        size_t size()const{return Field->NFaces;}
+        ScalarType operator[](size_t Face)const{return Field->Get(Frame,Face);}
+        View(const FrameScalarField *_Field,size_t _Frame):Field(_Field),Frame(_Frame){}
+    };
+
+    size_t size()const{return NFrames;}
+
+    size_t NumFaces()const{return NFaces;}
+
+    size_t NumSlabs()const{return (NFrames+FRAME_SLAB_SIZE-1)/FRAME_SLAB_SIZE;}
+
+    View operator[](size_t Frame)const
+    {
+        assert(Frame<NFrames);
+        return View(this,Frame);
+    }
+
+    FieldPrecision GetPrecision()const{return Precision;}
+
+    void Clear()
+    {
+        std::vector<std::vector<double> >().swap(DataD);
+        std::vector<std::vector<float> >().swap(DataF);
+        std::vector<std::vector<uint16_t> >().swap(DataQ);
+        NFrames=0;
+        NFaces=0;
+    }
+
+    void Allocate(size_t NumFrames,size_t NumFaces,FieldPrecision _Precision,
+                  bool AllocSlabs=true)
+    {
+        Clear();
+        Precision=_Precision;
+        NFrames=NumFrames;
+        NFaces=NumFaces;
+        if (Precision==FPDouble)DataD.resize(NumSlabs());
+        if (Precision==FPFloat)DataF.resize(NumSlabs());
+        if (Precision==FPQuantized)DataQ.resize(NumSlabs());
+        for (size_t i=0;(i<NumSlabs())&&(AllocSlabs);i++)
+            AllocateSlab(i);
+    }
+
+    void AllocateSlab(size_t Slab)
+    {
+        assert(Slab<NumSlabs());
+        size_t SlabFrames=std::min((size_t)FRAME_SLAB_SIZE,NFrames-Slab*FRAME_SLAB_SIZE);
+        size_t Size=SlabFrames*NFaces;
+        if (Precision==FPDouble)DataD[Slab].assign(Size,0);
+        if (Precision==FPFloat)DataF[Slab].assign(Size,0);
+        if (Precision==FPQuantized)DataQ[Slab].assign(Size,0);
+    }
+
+    void ReleaseSlab(size_t Slab)
+    {
+        assert(Slab<NumSlabs());
+        if (Precision==FPDouble)std::vector<double>().swap(DataD[Slab]);
+        if (Precision==FPFloat)std::vector<float>().swap(DataF[Slab]);
+        if (Precision==FPQuantized)std::vector<uint16_t>().swap(DataQ[Slab]);
+    }
+
+    void Set(size_t Frame,size_t Face,const ScalarType &Val)
+    {
+        assert(Frame<NFrames);
+        assert(Face<NFaces);
+        size_t Slab=Frame/FRAME_SLAB_SIZE;
+        size_t Index=Offset(Frame,Face);
+        if (Precision==FPDouble)DataD[Slab][Index]=Val;
+        else if (Precision==FPFloat)DataF[Slab][Index]=(float)Val;
+        else DataQ[Slab][Index]=FloatToHalf((float)Val);
+    }
+
+    ScalarType Get(size_t Frame,size_t Face)const
+    {
+        assert(Frame<NFrames);
+        assert(Face<NFaces);
+        size_t Slab=Frame/FRAME_SLAB_SIZE;
+        size_t Index=Offset(Frame,Face);
+        if (Precision==FPDouble)return (ScalarType)DataD[Slab][Index];
+        if (Precision==FPFloat)return (ScalarType)DataF[Slab][Index];
+        return (ScalarType)HalfToFloat(DataQ[Slab][Index]);
+    }
+
+    void Swap(FrameScalarField &Other)
+    {
+        std::swap(Precision,Other.Precision);
+        std::swap(NFrames,Other.NFrames);
+        std::swap(NFaces,Other.NFaces);
+        DataD.swap(Other.DataD);
+        DataF.swap(Other.DataF);
+        DataQ.swap(Other.DataQ);
+    }
+
+    size_t MemoryBytes()const
+    {
+        size_t Bytes=0;
+        for (size_t i=0;i<DataD.size();i++)Bytes+=DataD[i].size()*sizeof(double);
+        for (size_t i=0;i<DataF.size();i++)Bytes+=DataF[i].size()*sizeof(float);
+        for (size_t i=0;i<DataQ.size();i++)Bytes+=DataQ[i].size()*sizeof(uint16_t);
+        return Bytes;
+    }
+
+    FrameScalarField():Precision(FPDouble),NFrames(0),NFaces(0){}
+};
+
+#endif
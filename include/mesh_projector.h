@@ -0,0 +1,344 @@
+#ifndef MESH_PROJECTOR
+#define MESH_PROJECTOR
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+#include "parallel_for.h"
+
+//result of a batch of closest point queries, one entry per query point
+//stored as structure of arrays: face index and barycentric coordinates
+//of the closest point with respect to the vertices of that face
+template <class ScalarType>
+struct ProjectionBatch
+{
+    std::vector<size_t> FaceIdx;
+    std::vector<ScalarType> Bary0,Bary1,Bary2;
+    std::vector<ScalarType> SqDist;
+
+    void Resize(size_t Size)
+    {
+        FaceIdx.resize(Size);
+        Bary0.resize(Size);
+        Bary1.resize(Size);
+        Bary2.resize(Size);
+        SqDist.resize(Size);
+    }
+
+    size_t Size()const{return FaceIdx.size();}
+
+    template <class CoordType>
+    CoordType Bary(size_t i)const
+    {
+        return CoordType(Bary0[i],Bary1[i],Bary2[i]);
+    }
+};
+
+//closest point queries on the triangles of a mesh, answered by a bounding
+//volume hierarchy; the triangles are copied when the hierarchy is built,
+//so queries are thread safe and batches run in parallel
+template <class TriMeshType>
+class MeshProjector
+{
+    typedef typename TriMeshType::CoordType CoordType;
+    typedef typename TriMeshType::ScalarType ScalarType;
+
+    struct Node
+    {
+        double Min[3];
+        double Max[3];
+        //children are Left and Left+1, leaves have Count>0
+        size_t Left;
+        size_t Start;
+        size_t Count;
+    };
+
+    //vertices of each triangle
+    std::vector<double> TriX[3],TriY[3],TriZ[3];
+    std::vector<size_t> Order;
+    std::vector<Node> Nodes;
+
+    static const size_t LeafSize=4;
+
+    void FitNode(Node &N)
+    {
+        for (size_t k=0;k<3;k++)
+        {
+            N.Min[k]=std::numeric_limits<double>::max();
+            N.Max[k]=-std::numeric_limits<double>::max();
+        }
+        for (size_t i=N.Start;i<N.Start+N.Count;i++)
+        {
+            size_t IndexF=Order[i];
+            for (size_t j=0;j<3;j++)
+            {
+                double P[3]={TriX[j][IndexF],TriY[j][IndexF],TriZ[j][IndexF]};
+                for (size_t k=0;k<3;k++)
+                {
+                    N.Min[k]=std::min(N.Min[k],P[k]);
+                    N.Max[k]=std::max(N.Max[k],P[k]);
+                }
+            }
+        }
+    }
+
+    //split at the median of the centroids along the longest axis
+    void BuildNode(size_t IndexN,const std::vector<double> &Centroid)
+    {
+        FitNode(Nodes[IndexN]);
+        if (Nodes[IndexN].Count<=LeafSize)return;
+
+        size_t Axis=0;
+        double Extent=-1;
+        for (size_t k=0;k<3;k++)
+        {
+            double CurrExt=Nodes[IndexN].Max[k]-Nodes[IndexN].Min[k];
+            if (CurrExt<=Extent)continue;
+            Extent=CurrExt;
+            Axis=k;
+        }
+
+        size_t Start=Nodes[IndexN].Start;
+        size_t Count=Nodes[IndexN].Count;
+        size_t Half=Count/2;
+        std::nth_element(Order.begin()+Start,Order.begin()+Start+Half,Order.begin()+Start+Count,
+                         [&](size_t F0,size_t F1){return Centroid[F0*3+Axis]<Centroid[F1*3+Axis];});
+
+        size_t Left=Nodes.size();
+        Nodes.resize(Nodes.size()+2);
+        Nodes[IndexN].Left=Left;
+        Nodes[IndexN].Count=0;
+        Nodes[Left].Start=Start;
+        Nodes[Left].Count=Half;
+        Nodes[Left+1].Start=Start+Half;
+        Nodes[Left+1].Count=Count-Half;
+        BuildNode(Left,Centroid);
+        BuildNode(Left+1,Centroid);
+    }
+
+    static double BoxSqDist(const Node &N,const double P[3])
+    {
+        double SqD=0;
+        for (size_t k=0;k<3;k++)
+        {
+            double D=std::max(std::max(N.Min[k]-P[k],P[k]-N.Max[k]),0.0);
+            SqD+=D*D;
+        }
+        return SqD;
+    }
+
+    static double Dot(const double A[3],const double B[3])
+    {
+        return A[0]*B[0]+A[1]*B[1]+A[2]*B[2];
+    }
+
+    //closest point on triangle ABC to P, as barycentric coordinates
+    //(Ericson, Real-Time Collision Detection, 5.1.5)
+    static void ClosestOnTriangle(const double P[3],const double A[3],
+                                  const double B[3],const double C[3],
+                                  double Bary[3])
+    {
+        double AB[3],AC[3],AP[3];
+        for (size_t k=0;k<3;k++)
+        {
+            AB[k]=B[k]-A[k];
+            AC[k]=C[k]-A[k];
+            AP[k]=P[k]-A[k];
+        }
+        double d1=Dot(AB,AP),d2=Dot(AC,AP);
+        if ((d1<=0)&&(d2<=0)){Bary[0]=1;Bary[1]=0;Bary[2]=0;return;}
+
+        double BP[3];
+        for (size_t k=0;k<3;k++)BP[k]=P[k]-B[k];
+        double d3=Dot(AB,BP),d4=Dot(AC,BP);
+        if ((d3>=0)&&(d4<=d3)){Bary[0]=0;Bary[1]=1;Bary[2]=0;return;}
+
+        double vc=d1*d4-d3*d2;
+        if ((vc<=0)&&(d1>=0)&&(d3<=0)&&(d1-d3>0))
+        {
+            double v=d1/(d1-d3);
+            Bary[0]=1-v;Bary[1]=v;Bary[2]=0;
+            return;
+        }
+
+        double CP[3];
+        for (size_t k=0;k<3;k++)CP[k]=P[k]-C[k];
+        double d5=Dot(AB,CP),d6=Dot(AC,CP);
+        if ((d6>=0)&&(d5<=d6)){Bary[0]=0;Bary[1]=0;Bary[2]=1;return;}
+
+        double vb=d5*d2-d1*d6;
+        if ((vb<=0)&&(d2>=0)&&(d6<=0)&&(d2-d6>0))
+        {
+            double w=d2/(d2-d6);
+            Bary[0]=1-w;Bary[1]=0;Bary[2]=w;
+            return;
+        }
+
+        double va=d3*d6-d5*d4;
+        if ((va<=0)&&((d4-d3)>=0)&&((d5-d6)>=0)&&((d4-d3)+(d5-d6)>0))
+        {
+            double w=(d4-d3)/((d4-d3)+(d5-d6));
+            Bary[0]=0;Bary[1]=1-w;Bary[2]=w;
+            return;
+        }
+
+        double Denom=va+vb+vc;
+        if (Denom==0)
+        {
+            //degenerate triangle, fall back to its first vertex
+            Bary[0]=1;Bary[1]=0;Bary[2]=0;
+            return;
+        }
+        double v=vb/Denom;
+        double w=vc/Denom;
+        Bary[0]=1-v-w;Bary[1]=v;Bary[2]=w;
+    }
+
+    double TriangleSqDist(size_t IndexF,const double P[3],double Bary[3])const
+    {
+        double V[3][3];
+        for (size_t j=0;j<3;j++)
+        {
+            V[j][0]=TriX[j][IndexF];
+            V[j][1]=TriY[j][IndexF];
+            V[j][2]=TriZ[j][IndexF];
+        }
+        ClosestOnTriangle(P,V[0],V[1],V[2],Bary);
+        double SqD=0;
+        for (size_t k=0;k<3;k++)
+        {
+            double Closest=V[0][k]*Bary[0]+V[1][k]*Bary[1]+V[2][k]*Bary[2];
+            SqD+=(Closest-P[k])*(Closest-P[k]);
+        }
+        return SqD;
+    }
+
+public:
+
+    size_t NumFaces()const{return Order.size();}
+
+    void Build(const TriMeshType &mesh)
+    {
+        size_t NumF=mesh.face.size();
+        for (size_t j=0;j<3;j++)
+        {
+            TriX[j].resize(NumF);
+            TriY[j].resize(NumF);
+            TriZ[j].resize(NumF);
+        }
+        std::vector<double> Centroid(NumF*3);
+        for (size_t i=0;i<NumF;i++)
+        {
+            for (size_t j=0;j<3;j++)
+            {
+                const CoordType &P=mesh.face[i].cP(j);
+                TriX[j][i]=P.X();
+                TriY[j][i]=P.Y();
+                TriZ[j][i]=P.Z();
+            }
+            Centroid[i*3+0]=(TriX[0][i]+TriX[1][i]+TriX[2][i])/3;
+            Centroid[i*3+1]=(TriY[0][i]+TriY[1][i]+TriY[2][i])/3;
+            Centroid[i*3+2]=(TriZ[0][i]+TriZ[1][i]+TriZ[2][i])/3;
+        }
+
+        Order.resize(NumF);
+        for (size_t i=0;i<NumF;i++)
+            Order[i]=i;
+
+        Nodes.clear();
+        if (NumF==0)return;
+        Nodes.reserve(2*(NumF/LeafSize+1));
+        Nodes.resize(1);
+        Nodes[0].Start=0;
+        Nodes[0].Count=NumF;
+        BuildNode(0,Centroid);
+    }
+
+    //index of the closest face to Pos, with the barycentric coordinates
+    //of the closest point and its squared distance
+    size_t Closest(const CoordType &Pos,CoordType &Bary,ScalarType &SqDist)const
+    {
+        assert(Nodes.size()>0);
+        double P[3]={(double)Pos.X(),(double)Pos.Y(),(double)Pos.Z()};
+        double BestSqD=std::numeric_limits<double>::max();
+        double BestBary[3]={1,0,0};
+        size_t BestF=0;
+
+        size_t Stack[64];
+        size_t StackSize=0;
+        Stack[StackSize++]=0;
+        while (StackSize>0)
+        {
+            const Node &N=Nodes[Stack[--StackSize]];
+            if (BoxSqDist(N,P)>=BestSqD)continue;
+            if (N.Count>0)
+            {
+                for (size_t i=N.Start;i<N.Start+N.Count;i++)
+                {
+                    double CurrBary[3];
+                    double SqD=TriangleSqDist(Order[i],P,CurrBary);
+                    if (SqD>=BestSqD)continue;
+                    BestSqD=SqD;
+                    BestF=Order[i];
+                    BestBary[0]=CurrBary[0];
+                    BestBary[1]=CurrBary[1];
+                    BestBary[2]=CurrBary[2];
+                }
+                continue;
+            }
+            //visit the nearest child first
+            double D0=BoxSqDist(Nodes[N.Left],P);
+            double D1=BoxSqDist(Nodes[N.Left+1],P);
+            assert(StackSize+2<=64);
+            if (D0<D1)
+            {
+                Stack[StackSize++]=N.Left+1;
+                Stack[StackSize++]=N.Left;
+            }
+            else
+            {
+                Stack[StackSize++]=N.Left;
+                Stack[StackSize++]=N.Left+1;
+            }
+        }
+        Bary=CoordType(BestBary[0],BestBary[1],BestBary[2]);
+        SqDist=BestSqD;
+        return BestF;
+    }
+
+    //point of a face given its barycentric coordinates,
+    //on the triangle as it was when the hierarchy was built
+    CoordType Interpolate(size_t IndexF,const CoordType &Bary)const
+    {
+        assert(IndexF<NumFaces());
+        return CoordType(TriX[0][IndexF]*Bary.X()+TriX[1][IndexF]*Bary.Y()+TriX[2][IndexF]*Bary.Z(),
+                         TriY[0][IndexF]*Bary.X()+TriY[1][IndexF]*Bary.Y()+TriY[2][IndexF]*Bary.Z(),
+                         TriZ[0][IndexF]*Bary.X()+TriZ[1][IndexF]*Bary.Y()+TriZ[2][IndexF]*Bary.Z());
+    }
+
+    //closest faces of a set of points, split among num_threads workers
+    //(0 means one per core)
+    void Project(const std::vector<CoordType> &Points,
+                 ProjectionBatch<ScalarType> &Result,
+                 size_t num_threads=0)const
+    {
+        Result.Resize(Points.size());
+        ParallelForRange(Points.size(),num_threads,
+                         [&](size_t Begin,size_t End,size_t)
+        {
+            for (size_t i=Begin;i<End;i++)
+            {
+                CoordType Bary;
+                ScalarType SqD;
+                Result.FaceIdx[i]=Closest(Points[i],Bary,SqD);
+                Result.Bary0[i]=Bary.X();
+                Result.Bary1[i]=Bary.Y();
+                Result.Bary2[i]=Bary.Z();
+                Result.SqDist[i]=SqD;
+            }
+        });
+    }
+};
+
+#endif
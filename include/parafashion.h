@@ -16,18 +16,16 @@
 
 #include <igl/principal_curvature.h>
 #include <vcg/complex/algorithms/update/color.h>
-
-#define PRINT_PARAFASHION_TIMING 
-#ifdef PRINT_PARAFASHION_TIMING
-#include <chrono>
-using std::chrono::steady_clock;
-using std::chrono::duration_cast;
-using std::chrono::microseconds;
-#endif
+#include "patch_quality_cache.h"
+#include "uv_seed_store.h"
+#include "quality_proxy.h"
+#include "parafashion_checkpoint.h"
+#include "profiler.h"
 
 #define COUNT_PARAM_CALLS
 #ifdef COUNT_PARAM_CALLS
-int param_calls_count = 0;
+#include <atomic>
+std::atomic<int> param_calls_count(0);
 #endif
 
 enum PatchMode{PMMinTJuncions,PMAvgTJuncions,PMAllTJuncions};
@@ -243,6 +241,17 @@ class Parafashion
     std::vector<std::vector<std::pair<int,int> > > VertToVert;
     std::vector<int> DartTipVert;
 
+    //mirror map of the reference mesh, reused while it does not change
+    SymmetricMap<CoordType> SymmMap;
+
+    //mesh the field and the patches are computed on: half of the
+    //symmetrized deformed mesh, or the deformed mesh itself
+    TriMeshType &WorkMesh()
+    {
+        if (use_symmetry)return half_def_mesh;
+        return deformed_mesh;
+    }
+
 public:
 
     PatchMode PMode;
@@ -250,11 +259,31 @@ public:
     ParamMode UVMode;
 
     bool useFrames;
+    //number of animation poses (besides the rest one) used by the
+    //multi pose parametrization and how they are picked
+    //(unsigned int as it is edited by AntTweakBar as TW_TYPE_UINT32);
+    //the defaults pick the frame farthest from the rest pose, where the
+    //second pose used to always be frame 5
+    unsigned int frame_budget;
+    FrameSelection frame_selection;
+    //precision of the per frame curvature and stretch of the animation,
+    //float or quantized trade some accuracy for memory on long animations
+    FieldPrecision field_precision;
     bool match_valence;
     bool check_stress;
     bool use_darts;
     bool allow_self_glue;
     bool remove_along_symmetry;
+    //work on half of the symmetrized mesh and mirror the result,
+    //false processes the whole mesh for asymmetric garments
+    bool use_symmetry;
+    //solve for the symmetric deformation instead of iterating
+    bool direct_symmetrization;
+    //estimate the symmetry plane from the reference mesh instead of using x=0
+    bool auto_symmetry_plane;
+    //symmetry plane of the reference mesh, set by MakeMeshSymmetric or by
+    //a loaded checkpoint and used by every later mirroring
+    vcg::Plane3<ScalarType> symmetry_plane;
     ScalarType param_boundary;
     size_t max_corners;
     size_t dart_intervals;
@@ -262,6 +291,25 @@ public:
     ScalarType max_tension;
     ScalarType sample_rate;
     bool remesh_on_test;
+    //threads used by the final PMConformal/PMArap parametrization, 0 means
+    //one per core; 1 by default as the reentrancy of the LSCM and ARAP
+    //solvers on separate meshes has not been verified yet
+    size_t param_threads;
+    //memoize the quality of already evaluated patches
+    bool cache_quality;
+    //accept a candidate as it is when the layout assembled from the already
+    //flattened patches it merges is valid, the cloth solve is then skipped
+    //(the solver is never seeded: when the layout is rejected it starts over)
+    bool accept_seed_layout;
+    //estimate the quality on a decimated copy of the mesh first
+    bool proxy_quality;
+    ScalarType proxy_reduction;
+    ScalarType proxy_margin;
+    //when not empty BatchProcess saves the state after the field computation
+    //and after the tracing as checkpoint_prefix+"_field.pfck"/"_trace.pfck"
+    std::string checkpoint_prefix;
+    //BatchProcess starts from the checkpoint of this stage, if it can be loaded
+    PipelineStage resume_from;
     bool CheckUVIntersection;
     bool SmoothBeforeRemove;
     std::vector<typename TraceMesh::CoordType> PatchCornerPos;
@@ -308,53 +356,197 @@ public:
 
     public:
 
-        static ParamMode &UVMode()
+        //{PMConformal,PMArap,PMCloth};
+        struct QualityParams
         {
-            static ParamMode CurrUVMode=PMConformal;
-            return CurrUVMode;
+            ParamMode UVMode;
+            ScalarType MinQ;
+            ScalarType MaxQ;
+            bool RemeshOnTest;
+            bool ContinuousCheckSelfInt;
+            //reuse the value computed for an identical face set
+            bool UseCache;
+            //in PMCloth mode first check the layout assembled from previously
+            //flattened patches, and skip the solve if it is valid
+            bool AcceptSeedLayout;
+            //first estimate the quality on the coarse proxy, the full mesh
+            //is used only when the proxy stretch is within ProxyMargin
+            //(relative to the bounds) plus the length error measured on
+            //the decimated faces from MinQ or MaxQ
+            bool UseProxy;
+            ScalarType ProxyMargin;
+
+            QualityParams()
+            {
+                UVMode=PMConformal;
+                MinQ=-0.05;
+                MaxQ=0.05;
+                RemeshOnTest=false;
+                ContinuousCheckSelfInt=true;
+                UseCache=false;
+                AcceptSeedLayout=false;
+                UseProxy=false;
+                ProxyMargin=0.25;
+            }
+        };
+
+        //the parameters copied by every newly constructed functor, the tracer
+        //builds its functors when it is constructed so these must be set
+        //before (see SetQualityDefaults); the tracer evaluates the candidates
+        //one at a time, Params only makes each functor independent of the
+        //others
+        static QualityParams &Defaults()
+        {
+            static QualityParams Def;
+            return Def;
         }
 
-        //{PMConformal,PMArap,PMCloth};
+        //the tracer builds its functors with the default constructor, so the
+        //state that must outlive a single functor is static: it is shared by
+        //every Parafashion instance of the process and reset by TracePatch
 
-        static ScalarType & MinQ()
+        //thread safe; the key includes the quality parameters
+        //so it should be cleared only when the mesh changes
+        static PatchQualityCache<ScalarType> &Cache()
         {
-            static ScalarType MinV=-0.05;
-            return MinV;
+            static PatchQualityCache<ScalarType> QCache;
+            return QCache;
         }
 
-        static ScalarType & MaxQ()
+        //UVs of the last flattened patches, used to seed the merged candidates,
+        //emptied at every tracing so the seeds only come from the current run
+        static UVSeedStore<MeshType> &Seeds()
         {
-            static ScalarType MaxV=0.05;
-            return MaxV;
+            static UVSeedStore<MeshType> SeedS;
+            return SeedS;
         }
 
-        static bool & RemeshOnTest()
+        //coarse version of the traced mesh, set before tracing
+        static QualityProxy<MeshType> &Proxy()
         {
-            static bool rem=false;
-            return rem;
+            static QualityProxy<MeshType> QProxy;
+            return QProxy;
         }
 
-        static bool &ContinuousCheckSelfInt()
-        {
-            static bool check=false;
-            return check;
-        }
+        //per instance state, never modified while evaluating
+        QualityParams Params;
 
-        MeshArapQuality(){ContinuousCheckSelfInt()=true;}
+        MeshArapQuality(){Params=Defaults();}
+
+        MeshArapQuality(const QualityParams &_Params):Params(_Params){}
 
         ScalarType operator()(MeshType &m) const
         {
+            PARAFASHION_PROFILE("quality");
 
-            #ifdef PRINT_PARAFASHION_TIMING
-            steady_clock::time_point pre_param = steady_clock::now();
-            #endif
+            if (!Params.UseCache)
+                return Evaluate(m);
+
+            //the key must be computed before evaluating, remeshing changes m
+            typename PatchQualityCache<ScalarType>::KeyType Key;
+            Key=PatchQualityCache<ScalarType>::ComputeKey(m,Params);
+            ScalarType A;
+            if (Cache().Find(Key,A))
+                return A;
 
+            A=Evaluate(m);
+            Cache().Insert(Key,A);
+            return A;
+        }
+
+        //estimate the quality on the proxy, returns true only if the estimate
+        //is far enough from the bounds to be trusted, A is then the result
+        bool EvaluateOnProxy(const MeshType &m,ScalarType &A) const
+        {
+            PARAFASHION_PROFILE("quality_proxy");
+
+            MeshType ProxyPatch;
+            ScalarType Error;
+            if (!Proxy().GetProxyPatch(m,ProxyPatch,Error))return false;
+
+            //the stretch measured on the proxy can be off by the length it
+            //lost in the decimation, plus the difference of the coarser solve
+            ScalarType MinT=Params.MinQ*(1-Params.ProxyMargin)+Error;
+            ScalarType MaxT=Params.MaxQ*(1-Params.ProxyMargin)-Error;
+            ScalarType MinL=Params.MinQ*(1+Params.ProxyMargin)-Error;
+            ScalarType MaxL=Params.MaxQ*(1+Params.ProxyMargin)+Error;
+            //too coarse to accept anything, it can still reject
+            bool CanAccept=(MinT<MaxT);
+
+            std::vector<typename TriMeshType::ScalarType> StretchU;
+            std::vector<typename TriMeshType::ScalarType> StretchV;
+            if (Params.UVMode==PMCloth)
+            {
+                bool DoSelfInt=false;
+                ClothParametrize<TriMeshType>(ProxyPatch,StretchU,StretchV,
+                                              CanAccept?MaxT:Params.MaxQ,
+                                              Params.ContinuousCheckSelfInt,DoSelfInt);
+                //could be caused by the coarse border
+                if (DoSelfInt)
+                {
+                    Proxy().CountBorderline();
+                    return false;
+                }
+            }
+            else
+            {
+                vcg::tri::InitializeArapWithLSCM(ProxyPatch,0);
+                vcg::tri::Distortion<TraceMesh,false>::SetQasDistorsion(ProxyPatch,vcg::tri::Distortion<TraceMesh,false>::EdgeComprStretch);
+                for (size_t i=0;i<ProxyPatch.face.size();i++)
+                {
+                    StretchU.push_back(ProxyPatch.face[i].Q());
+                    StretchV.push_back(ProxyPatch.face[i].Q());
+                }
+            }
+
+            ScalarType AreaT=0;
+            ScalarType AreaL=0;
+            for (size_t i=0;i<ProxyPatch.face.size();i++)
+            {
+                ScalarType AreaF=vcg::DoubleArea(ProxyPatch.face[i]);
+                if ((StretchU[i]<MinT)||(StretchU[i]>MaxT)||
+                    (StretchV[i]<MinT)||(StretchV[i]>MaxT))AreaT+=AreaF;
+                if ((StretchU[i]<MinL)||(StretchU[i]>MaxL)||
+                    (StretchV[i]<MinL)||(StretchV[i]>MaxL))AreaL+=AreaF;
+            }
+
+            //clearly inside the bounds
+            if ((CanAccept)&&(AreaT==0))
+            {
+                Proxy().CountAccepted();
+                A=0;
+                return true;
+            }
+            //clearly outside
+            if (AreaL>0)
+            {
+                Proxy().CountRejected();
+                A=AreaL;
+                return true;
+            }
+            Proxy().CountBorderline();
+            return false;
+        }
+
+        ScalarType Evaluate(MeshType &m) const
+        {
             #ifdef COUNT_PARAM_CALLS
             param_calls_count ++;
             #endif
 
-            if (RemeshOnTest())
+#ifndef MULTI_FRAME
+            if ((Params.UseProxy)&&(!Params.RemeshOnTest))
+            {
+                ScalarType A;
+                if (EvaluateOnProxy(m,A))return A;
+            }
+#endif
+
+            if (Params.RemeshOnTest)
+            {
+                PARAFASHION_PROFILE("quality_remesh");
                 Remesh(m);
+            }
             //RemeshByDeci(m);
 
             //            size_t numH=vcg::tri::Clean<TriMeshType>::CountHoles(m);
@@ -367,20 +559,32 @@ public:
             //assert(numH==1);
 
             //,PMArap,
-            if (UVMode()==PMCloth)
+            if (Params.UVMode==PMCloth)
             {
+#ifndef MULTI_FRAME
+                //a merge of two valid patches often is valid as it is
+                if (Params.AcceptSeedLayout)
+                {
+                    Eigen::MatrixXd V_uv;
+                    if ((Seeds().GetSeed(m,V_uv))&&
+                        (AcceptClothSeed<TriMeshType>(m,V_uv,Params.MinQ,Params.MaxQ,
+                                                      Params.ContinuousCheckSelfInt)))
+                    {
+                        Seeds().Store(m);
+                        return 0;
+                    }
+                }
+#endif
                 std::vector<typename TriMeshType::ScalarType> StretchU;
                 std::vector<typename TriMeshType::ScalarType> StretchV;
                 bool DoSelfInt=false;
+                ProfileScope SolveScope("quality_solve");
                 bool success = ClothParametrize<TriMeshType>(m, StretchU,StretchV,
-                                                             MaxQ(),ContinuousCheckSelfInt(),
+                                                             Params.MaxQ,Params.ContinuousCheckSelfInt,
                                                              DoSelfInt); // quality-check param, NOT the final one you see on screen
-                #ifdef PRINT_PARAFASHION_TIMING
-                steady_clock::time_point post_param = steady_clock::now();
-                int param_time = duration_cast<microseconds>(post_param - pre_param).count();
-                std::cout << "Param time : " << param_time << " [µs]" << std::endl;
-                #endif
+                SolveScope.Stop();
                 //if ((!success)||(DoSelfInt)) return 1000;
+                PARAFASHION_PROFILE("quality_scan");
                 ScalarType A=0;
                 if (DoSelfInt)
                 {
@@ -390,7 +594,12 @@ public:
                 }
                 else
                 {
-                    if (success) return 0;
+                    if (success)
+                    {
+                        if (Params.AcceptSeedLayout)
+                            Seeds().Store(m);
+                        return 0;
+                    }
 
                     //                    //then return the entire area
                     //                    for (size_t i=0;i<m.face.size();i++)
@@ -398,13 +607,13 @@ public:
 
                     for (size_t i=0;i<m.face.size();i++)
                     {
-                        if (StretchU[i]<MinQ())
+                        if (StretchU[i]<Params.MinQ)
                             A+=vcg::DoubleArea(m.face[i]);
-                        if (StretchU[i]>MaxQ())
+                        if (StretchU[i]>Params.MaxQ)
                             A+=vcg::DoubleArea(m.face[i]);
-                        if (StretchV[i]<MinQ())
+                        if (StretchV[i]<Params.MinQ)
                             A+=vcg::DoubleArea(m.face[i]);
-                        if (StretchV[i]>MaxQ())
+                        if (StretchV[i]>Params.MaxQ)
                             A+=vcg::DoubleArea(m.face[i]);
                     }
                 }
@@ -412,40 +621,36 @@ public:
                 return A;
             }
 
-            if (UVMode()==PMConformal)
+            if (Params.UVMode==PMConformal)
             {
+                ProfileScope SolveScope("quality_solve");
                 vcg::tri::InitializeArapWithLSCM(m,0);
-                #ifdef PRINT_PARAFASHION_TIMING
-                steady_clock::time_point post_param = steady_clock::now();
-                int param_time = duration_cast<microseconds>(post_param - pre_param).count();
-                std::cout << "Param time : " << param_time << " [µs]" << std::endl;
-                #endif
+                SolveScope.Stop();
                 vcg::tri::Distortion<TraceMesh,false>::SetQasDistorsion(m,vcg::tri::Distortion<TraceMesh,false>::EdgeComprStretch);
+                PARAFASHION_PROFILE("quality_scan");
                 ScalarType A=0;
                 for (size_t i=0;i<m.face.size();i++)
                 {
-                    if (m.face[i].Q()<MinQ())A+=vcg::DoubleArea(m.face[i]);
-                    if (m.face[i].Q()>MaxQ())A+=vcg::DoubleArea(m.face[i]);
+                    if (m.face[i].Q()<Params.MinQ)A+=vcg::DoubleArea(m.face[i]);
+                    if (m.face[i].Q()>Params.MaxQ)A+=vcg::DoubleArea(m.face[i]);
                 }
                 std::cout<<"Area:"<<A<<std::endl;
                 return A;
             }
 
-            if (UVMode()==PMArap)
+            if (Params.UVMode==PMArap)
             {
+                ProfileScope SolveScope("quality_solve");
                 vcg::tri::InitializeArapWithLSCM(m,0);
                 //vcg::tri::OptimizeUV_ARAP(m,5,0,true);
-#ifdef PRINT_PARAFASHION_TIMING
-                steady_clock::time_point post_param = steady_clock::now();
-                int param_time = duration_cast<microseconds>(post_param - pre_param).count();
-                std::cout << "Param time : " << param_time << " [µs]" << std::endl;
-#endif
+                SolveScope.Stop();
                 vcg::tri::Distortion<TraceMesh,false>::SetQasDistorsion(m,vcg::tri::Distortion<TraceMesh,false>::EdgeComprStretch);
+                PARAFASHION_PROFILE("quality_scan");
                 ScalarType A=0;
                 for (size_t i=0;i<m.face.size();i++)
                 {
-                    if (m.face[i].Q()<(MinQ()))A+=vcg::DoubleArea(m.face[i]);
-                    if (m.face[i].Q()>MaxQ())A+=vcg::DoubleArea(m.face[i]);
+                    if (m.face[i].Q()<Params.MinQ)A+=vcg::DoubleArea(m.face[i]);
+                    if (m.face[i].Q()>Params.MaxQ)A+=vcg::DoubleArea(m.face[i]);
                 }
                 return A;
             }
@@ -457,8 +662,8 @@ public:
             //            ScalarType A=0;
             //            for (size_t i=0;i<m.face.size();i++)
             //            {
-            //                if (m.face[i].Q()<(MinQ()))A+=vcg::DoubleArea(m.face[i]);
-            //                if (m.face[i].Q()>MaxQ())A+=vcg::DoubleArea(m.face[i]);
+            //                if (m.face[i].Q()<Params.MinQ)A+=vcg::DoubleArea(m.face[i]);
+            //                if (m.face[i].Q()>Params.MaxQ)A+=vcg::DoubleArea(m.face[i]);
             //            }
             //return (A/SumA);
 
@@ -553,6 +758,8 @@ public:
     void TracePatch(bool SaveStep=true,
                     bool DebugMSG=false)
     {
+        PARAFASHION_PROFILE("trace");
+
         if (SaveStep)
         {
             deformed_mesh.Clear();
@@ -566,13 +773,16 @@ public:
 
         typedef PatchTracer<TriMeshType,MeshArapQuality<TriMeshType> > PTracerType;
 
-        half_def_mesh.UpdateAttributes();
+        TriMeshType &work_mesh=WorkMesh();
+        work_mesh.UpdateAttributes();
 
 
-        VertexFieldGraph<TriMeshType> VGraph(half_def_mesh);
+        VertexFieldGraph<TriMeshType> VGraph(work_mesh);
         VGraph.InitGraph(DebugMSG);
 
 
+        //the tracer copies the defaults into the functors it builds
+        SetQualityDefaults();
         PTracerType PTr(VGraph);
 
         PTr.MaxVal=max_corners;
@@ -584,19 +794,20 @@ public:
         PTr.CClarkability=-1;
         PTr.sample_ratio=sample_rate;
         //PTr.FirstBorder=true;
-        half_def_mesh.UpdateAttributes();
+        work_mesh.UpdateAttributes();
         bool PreRemoveStep=true;
         PTr.PrioMode=PrioMode;
         PTr.CheckUVIntersection=CheckUVIntersection;
 
         if (max_compression<max_tension)
-        {
-            MeshArapQuality<TriMeshType>::UVMode()=UVMode;
-            MeshArapQuality<TriMeshType>::MaxQ()=max_tension;
-            MeshArapQuality<TriMeshType>::MinQ()=max_compression;
-            MeshArapQuality<TriMeshType>::RemeshOnTest()=remesh_on_test;
             PTr.check_quality_functor=check_stress;
-        }
+        //the field or the frames may have changed since the last tracing
+        MeshArapQuality<TriMeshType>::Cache().Clear();
+        MeshArapQuality<TriMeshType>::Seeds().Clear();
+        if (proxy_quality)
+            MeshArapQuality<TriMeshType>::Proxy().Init(work_mesh,proxy_reduction);
+        else
+            MeshArapQuality<TriMeshType>::Proxy().Clear();
 
         if (PMode==PMMinTJuncions)
         {
@@ -645,9 +856,9 @@ public:
 
         //be sure to have selected all the paths
         std::vector<std::vector<vcg::face::Pos<FaceType> > > PathPos;
-        vcg::tri::UpdateFlags<TriMeshType>::FaceClearFaceEdgeS(half_def_mesh);
+        vcg::tri::UpdateFlags<TriMeshType>::FaceClearFaceEdgeS(work_mesh);
         GetPathPos(VGraph,PTr.ChoosenPaths,PathPos);
-        half_def_mesh.SelectPos(PathPos,true);
+        work_mesh.SelectPos(PathPos,true);
 
         //        std::cout<<"Remaining "<<PTr.ChoosenPaths.size()<<" paths"<<std::endl;
         //        //copy partition on quality
@@ -657,8 +868,11 @@ public:
         //PTr.ColorByPartitions();
 
         //then copy everything
-        Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh);
-        Symm.CopyPropertiesFromHalfDefMesh(half_def_mesh);
+        if (use_symmetry)
+        {
+            Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh,symmetry_plane);
+            Symm.CopyPropertiesFromHalfDefMesh(half_def_mesh);
+        }
 
 
         deformed_mesh.UpdateAttributes();
@@ -672,6 +886,7 @@ public:
 
     void  ComputeField(bool SaveStep=true)
     {
+        PARAFASHION_PROFILE("field");
 
         if (SaveStep)
         {
@@ -683,29 +898,33 @@ public:
             half_def_mesh.UpdateAttributes();
         }
 
-        //compute field on half mesh
-        half_def_mesh.UpdateSharpFeaturesFromSelection();
+        //compute field on half mesh (or on the whole one)
+        TriMeshType &work_mesh=WorkMesh();
+        work_mesh.UpdateSharpFeaturesFromSelection();
 
-        FieldComputation<TriMeshType>::ComputeField(half_def_mesh,AManag,FMode,1000);//,align_border);
-        vcg::tri::CrossField<TriMeshType>::UpdateSingularByCross(half_def_mesh);
-        vcg::tri::CrossField<TriMeshType>::SetVertCrossVectorFromFace(half_def_mesh);
-        half_def_mesh.InitSingVert();
-        half_def_mesh.InitRPos();
-
-
-        Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh);
+        FieldComputation<TriMeshType>::ComputeField(work_mesh,AManag,FMode,1000);//,align_border);
+        vcg::tri::CrossField<TriMeshType>::UpdateSingularByCross(work_mesh);
+        vcg::tri::CrossField<TriMeshType>::SetVertCrossVectorFromFace(work_mesh);
+        work_mesh.InitSingVert();
+        work_mesh.InitRPos();
 
         //        //THEN REMOVE IF THEY ARE SOFT
         //        vcg::tri::UpdateFlags<TriMeshType>::FaceClearFaceEdgeS(half_def_mesh);
         //        half_def_mesh.UpdateSharpFeaturesFromSelection();
 
-        PreProcessMesh(half_def_mesh,false);
-        Symm.CopyFromHalfDefMesh(half_def_mesh);
+        PreProcessMesh(work_mesh,false);
+        if (use_symmetry)
+        {
+            Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh,symmetry_plane);
+            Symm.CopyFromHalfDefMesh(half_def_mesh);
 
-        //CHECK
-        deformed_mesh.UpdateSharpFeaturesFromSelection();
+            //CHECK
+            deformed_mesh.UpdateSharpFeaturesFromSelection();
 
-        Symm.CopyFieldFromHalfDefMesh(half_def_mesh);
+            Symm.CopyFieldFromHalfDefMesh(half_def_mesh);
+        }
+        else
+            deformed_mesh.UpdateSharpFeaturesFromSelection();
 
 
         if (SaveStep)
@@ -721,10 +940,15 @@ public:
     {
         //get the half mesh
         //std::cout<<"1"<<std::endl;
-        Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh);
-        Symm.GetHalfDefMesh(half_def_mesh);
+        if (use_symmetry)
+        {
+            Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh,symmetry_plane);
+            Symm.GetHalfDefMesh(half_def_mesh);
+        }
+        else
+            half_def_mesh.Clear();
         //std::cout<<"2"<<std::endl;
-        PathUI<TriMeshType> TPath(half_def_mesh);
+        PathUI<TriMeshType> TPath(WorkMesh());
         //std::cout<<"Size V:"<<PickedPoints.size()<<std::endl;
         TPath.AddSharpConstraints(PickedPoints);
         //        //std::cout<<"3"<<std::endl;
@@ -741,10 +965,22 @@ public:
     void MakeMeshSymmetric(const std::vector<std::vector<CoordType> > &PickedPoints,
                            bool SaveStep=true)
     {
+        PARAFASHION_PROFILE("symmetrize");
 
-        //make the mesh symmetric
-        Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh);
-        Symm.SymmetrizeDeformedMesh();
+        //make the mesh symmetric, without symmetry only the constraints are added
+        if (use_symmetry)
+        {
+            //the plane is kept for the copies from the half mesh later on
+            if (auto_symmetry_plane)
+                symmetry_plane=SymmetrizeDeformation<TriMeshType>::EstimateSymmetryPlane(reference_mesh);
+            else
+                symmetry_plane=SymmetrizeDeformation<TriMeshType>::DefaultPlane();
+
+            Symmetrizer<TriMeshType> Symm(deformed_mesh,reference_mesh,symmetry_plane);
+            Symm.direct_symmetrization=direct_symmetrization;
+            Symm.map_cache=&SymmMap;
+            Symm.SymmetrizeDeformedMesh();
+        }
 
         AddSharpConstraints(PickedPoints);
 
@@ -802,16 +1038,166 @@ public:
 
     void DoParametrize()
     {
+        PARAFASHION_PROFILE("global_param");
 
         Parametrizer<TriMeshType>::Parametrize(deformed_mesh,UVMode,
                                                SubMeshes, MeshToMesh,
                                                VertToVert,DartTipVert,
                                                continuity_seams,
                                                continuity_darts,
-                                               param_boundary);
+                                               param_boundary,
+                                               param_threads);
         //parametrized=true;
     }
 
+    std::string CheckpointPath(PipelineStage Stage)
+    {
+        if (Stage==PSField)return (checkpoint_prefix+"_field.pfck");
+        if (Stage==PSTrace)return (checkpoint_prefix+"_trace.pfck");
+        return std::string();
+    }
+
+    //hash of everything the state after Stage depends on: the input meshes,
+    //the constraints, the frames and the parameters of the stages up to it
+    uint64_t InputFingerprint(PipelineStage Stage,
+                              const std::vector<std::vector<CoordType> > &PickedPoints)
+    {
+        CheckpointFingerprint Print;
+        Print.Add((uint64_t)Stage);
+        Print.AddMesh(deformed_mesh_step0);
+        Print.AddMesh(reference_mesh_step0);
+        Print.Add(PickedPoints.size());
+        for (size_t i=0;i<PickedPoints.size();i++)
+        {
+            Print.Add(PickedPoints[i].size());
+            for (size_t j=0;j<PickedPoints[i].size();j++)
+                for (size_t k=0;k<3;k++)
+                    Print.AddScalar(PickedPoints[i][j].V(k));
+        }
+        //the frames are sampled, hashing all of them would read the whole
+        //(possibly memory mapped) cache at every run
+        const FrameCache &Frames=AManag.PosFrames();
+        Print.Add(Frames.NumFrames());
+        Print.Add(Frames.NumVerts());
+        size_t NumVal=Frames.NumFrames()*Frames.NumVerts()*3;
+        size_t NumSamples=std::min(NumVal,(size_t)4096);
+        for (size_t i=0;i<NumSamples;i++)
+        {
+            size_t IndexVal=(i*NumVal)/NumSamples;
+            size_t IndexFrame=IndexVal/(Frames.NumVerts()*3);
+            Print.AddScalar(Frames.Frame(IndexFrame)[IndexVal%(Frames.NumVerts()*3)]);
+        }
+
+        //symmetrization and field
+        Print.Add((uint64_t)FMode);
+        Print.Add((uint64_t)direct_symmetrization);
+        Print.Add((uint64_t)auto_symmetry_plane);
+        //used by the FMCurvatureFrames field
+        Print.Add((uint64_t)field_precision);
+        if (Stage<PSTrace)return Print.Value();
+
+        //tracing
+        Print.Add((uint64_t)PMode);
+        Print.Add((uint64_t)PrioMode);
+        Print.Add((uint64_t)UVMode);
+        Print.Add(max_corners);
+        Print.Add(dart_intervals);
+        Print.AddScalar(max_compression);
+        Print.AddScalar(max_tension);
+        Print.AddScalar(sample_rate);
+        Print.Add((uint64_t)match_valence);
+        Print.Add((uint64_t)check_stress);
+        Print.Add((uint64_t)use_darts);
+        Print.Add((uint64_t)allow_self_glue);
+        Print.Add((uint64_t)remesh_on_test);
+        Print.Add((uint64_t)CheckUVIntersection);
+        Print.Add((uint64_t)SmoothBeforeRemove);
+        Print.Add((uint64_t)check_T_junction);
+        Print.Add((uint64_t)final_removal);
+        Print.Add((uint64_t)accept_seed_layout);
+        Print.Add((uint64_t)proxy_quality);
+        Print.AddScalar(proxy_reduction);
+        Print.AddScalar(proxy_margin);
+        Print.Add((uint64_t)useFrames);
+        Print.Add(frame_budget);
+        Print.Add((uint64_t)frame_selection);
+        return Print.Value();
+    }
+
+    //parameters of the quality functors built by the next tracer, all of
+    //them are set at every call so nothing leaks from a previous run
+    void SetQualityDefaults()
+    {
+        typename MeshArapQuality<TriMeshType>::QualityParams &Def=
+                MeshArapQuality<TriMeshType>::Defaults();
+        Def.UVMode=UVMode;
+        Def.MaxQ=max_tension;
+        Def.MinQ=max_compression;
+        Def.RemeshOnTest=remesh_on_test;
+        Def.UseCache=cache_quality;
+        Def.AcceptSeedLayout=accept_seed_layout;
+        Def.UseProxy=proxy_quality;
+        Def.ProxyMargin=proxy_margin;
+    }
+
+    bool SaveStage(PipelineStage Stage,const std::string &path,
+                   uint64_t Fingerprint)
+    {
+        PARAFASHION_PROFILE("checkpoint_save");
+        std::vector<const TriMeshType*> Meshes;
+        Meshes.push_back(&deformed_mesh);
+        Meshes.push_back(&reference_mesh);
+        Meshes.push_back(&half_def_mesh);
+        bool Saved=SaveCheckpoint(path,Stage,Fingerprint,use_symmetry,
+                                  symmetry_plane,Meshes,PatchCornerPos);
+        if (Saved)
+            std::cout<<"Saved checkpoint "<<path<<std::endl;
+        return Saved;
+    }
+
+    bool LoadStage(PipelineStage Stage,const std::string &path,
+                   uint64_t Fingerprint)
+    {
+        PARAFASHION_PROFILE("checkpoint_load");
+        CleanMeshAttributes();
+
+        std::vector<TriMeshType*> Meshes;
+        Meshes.push_back(&deformed_mesh);
+        Meshes.push_back(&reference_mesh);
+        Meshes.push_back(&half_def_mesh);
+        vcg::Plane3<ScalarType> Plane;
+        std::vector<typename TraceMesh::CoordType> Corners;
+        if (!LoadCheckpoint(path,Stage,Fingerprint,use_symmetry,Plane,Meshes,Corners))
+        {
+            //do not leave half loaded meshes around
+            RestoreInitMesh();
+            return false;
+        }
+        PatchCornerPos.swap(Corners);
+        //the mirroring of the later stages needs the plane the
+        //checkpoint was computed with, possibly estimated
+        symmetry_plane=Plane;
+
+        //same state as at the end of ComputeField
+        WorkMesh().UpdateSharpFeaturesFromSelection();
+        deformed_mesh.UpdateSharpFeaturesFromSelection();
+        WorkMesh().InitSingVert();
+        WorkMesh().InitRPos();
+        deformed_mesh.InitRPos();
+        reference_mesh.InitRPos();
+
+        //so the GUI can trace again from here
+        if (Stage==PSField)
+        {
+            half_def_mesh_step2.Clear();
+            deformed_mesh_step2.Clear();
+            vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(half_def_mesh_step2,half_def_mesh);
+            vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(deformed_mesh_step2,deformed_mesh);
+        }
+        std::cout<<"Loaded checkpoint "<<path<<std::endl;
+        return true;
+    }
+
     void Init()
     {
         deformed_mesh_step0.Clear();
@@ -864,6 +1250,10 @@ public:
 
     void RemoveOnSymmetryPathIfPossible()
     {
+        //there is no symmetry line on the full mesh
+        if (!use_symmetry)return;
+
+        PARAFASHION_PROFILE("remove_symmetry");
         //select along boders, so it is kept as new border when merged
         //std::set<std::pair<CoordType,CoordType> > BorderE;
         for (size_t i=0;i<deformed_mesh.face.size();i++)
@@ -907,7 +1297,8 @@ public:
         //        PTracerType PTr(VGraph);
         //        PTr.InitTracer(100,false);
 
-        //initialize the tracer
+        //initialize the tracer, after the defaults it copies
+        SetQualityDefaults();
         PTracerType PTr(VGraph);
 
         PTr.CClarkability=-1;
@@ -928,12 +1319,10 @@ public:
 
 
         if (max_compression<max_tension)
-        {
-            MeshArapQuality<TriMeshType>::MaxQ()=max_tension;
-            MeshArapQuality<TriMeshType>::MinQ()=max_compression;
-            MeshArapQuality<TriMeshType>::RemeshOnTest()=remesh_on_test;
             PTr.check_quality_functor=check_stress;
-        }
+
+        //the patches stored by the tracing are on the half mesh
+        MeshArapQuality<TriMeshType>::Seeds().Clear();
 
         PTr.InitTracer(100,false);
 
@@ -963,7 +1352,7 @@ public:
                 CoordType P0=VGraph.NodePos(N0);
                 CoordType P1=VGraph.NodePos(N1);
                 CoordType AvgP=(P0+P1)/2;
-                CoordType Proj=Symmetrizer<TraceMesh>::SymmPlane().Projection(AvgP);
+                CoordType Proj=symmetry_plane.Projection(AvgP);
                 if ((Proj-AvgP).Norm()<0.0001)
                     PTr.ChoosenPaths[i].Unremovable=false;
             }
@@ -985,13 +1374,13 @@ public:
         typename vcg::tri::MeshToMatrix<TriMeshType>::MatrixXm Vf;
 
         Eigen::MatrixXd PD1,PD2,PV1,PV2;
-        vcg::tri::MeshToMatrix<TriMeshType>::GetTriMeshData(half_def_mesh,F,Vf);
+        vcg::tri::MeshToMatrix<TriMeshType>::GetTriMeshData(WorkMesh(),F,Vf);
         Eigen::MatrixXd V = Vf.template cast<double>();
 
         igl::principal_curvature(V,F,PD1,PD2,PV1,PV2,4,true);
 
         //then compute convexity
-        for (size_t i=0;i<half_def_mesh.vert.size();i++)
+        for (size_t i=0;i<WorkMesh().vert.size();i++)
         {
             ScalarType V0=PV1(i,0);
             ScalarType V1=PV2(i,0);
@@ -1010,7 +1399,7 @@ public:
         //then compute convexity
         std::vector<std::pair<ScalarType,size_t> > val;
 
-        for (size_t i=0;i<half_def_mesh.vert.size();i++)
+        for (size_t i=0;i<WorkMesh().vert.size();i++)
         {
             val.push_back(std::pair<ScalarType,size_t>(Values[i],i));
         }
@@ -1026,11 +1415,11 @@ public:
         //        }
         for (size_t i=0;i<val.size();i++)
         {
-            half_def_mesh.vert[val[i].second].Q()=i;
+            WorkMesh().vert[val[i].second].Q()=i;
         }
         //vcg::tri::UpdateQuality<TriMeshType>::Ve
-        vcg::tri::UpdateColor<TriMeshType>::PerVertexQualityRamp(half_def_mesh);
-        vcg::tri::io::ExporterPLY<TriMeshType>::Save(half_def_mesh,"TestCol.ply",vcg::tri::io::Mask::IOM_VERTCOLOR);
+        vcg::tri::UpdateColor<TriMeshType>::PerVertexQualityRamp(WorkMesh());
+        vcg::tri::io::ExporterPLY<TriMeshType>::Save(WorkMesh(),"TestCol.ply",vcg::tri::io::Mask::IOM_VERTCOLOR);
     }
 
     void BatchProcess(const std::vector<std::vector<CoordType> > &PickedPoints,
@@ -1040,15 +1429,43 @@ public:
                       bool writeTime=true)
     {
         RestoreInitMesh();
-        size_t t0=clock();
+        AManager.field_precision=field_precision;
+        //stage scopes also include the frame interpolation and the checkpoints
+        ProfileScope SymmScope("stage_symmetrize");
+
+        //before the frames are moved on the symmetrized mesh by the field
+        uint64_t FieldPrint=0,TracePrint=0;
+        if (!checkpoint_prefix.empty())
+        {
+            FieldPrint=InputFingerprint(PSField,PickedPoints);
+            TracePrint=InputFingerprint(PSTrace,PickedPoints);
+        }
+
+        PipelineStage Done=PSNone;
+        if ((resume_from!=PSNone)&&(!checkpoint_prefix.empty()))
+        {
+            if (LoadStage(resume_from,CheckpointPath(resume_from),
+                          (resume_from==PSField)?FieldPrint:TracePrint))
+                Done=resume_from;
+            else
+                std::cout<<"Cannot load checkpoint, running the whole pipeline"<<std::endl;
+        }
 
-        MakeMeshSymmetric(PickedPoints,false);
+        if (Done<PSField)
+            MakeMeshSymmetric(PickedPoints,false);
 
         //        vcg::tri::io::ExporterPLY<TriMeshType>::Save(half_def_mesh,"dede0ply");
 
-        size_t t1=clock();
-        ComputeField(false);
-        size_t t2=clock();
+        ScalarType TimeSymm=SymmScope.Stop();
+        ProfileScope FieldScope("stage_field");
+        if (Done<PSField)
+        {
+            ComputeField(false);
+            if (!checkpoint_prefix.empty())
+                SaveStage(PSField,CheckpointPath(PSField),FieldPrint);
+        }
+        ScalarType TimeField=FieldScope.Stop();
+        ProfileScope TraceScope("stage_trace");
         //        //TEST, REMOVE CONSTRAINT
         //        vcg::tri::io::ExporterPLY<TriMeshType>::Save(half_def_mesh,"dede1.ply");
         //        //TEST, REMOVE CONSTRAINTS
@@ -1057,15 +1474,19 @@ public:
 #ifdef MULTI_FRAME
         //std::vector<CoordType> OrigPos;
         std::vector<std::vector<CoordType> > VertPos;
-        if (useFrames)
-            AManager.InterpolateMultipleFramesOnMesh(half_def_mesh,3,VertPos);
-        else
-            AManager.InterpolateMultipleFramesOnMesh(half_def_mesh,0,VertPos);
-
-        assert(VertPos.size()>0);
-        for (size_t frame=0;frame<VertPos.size();frame++)
-            for (size_t i=0;i<VertPos[frame].size();i++)
-                half_def_mesh.vert[i].FramePos.push_back(VertPos[frame][i]);
+        //the traced checkpoint already has them
+        if (Done<PSTrace)
+        {
+            if (useFrames)
+                AManager.InterpolateMultipleFramesOnMesh(WorkMesh(),frame_budget,VertPos,frame_selection);
+            else
+                AManager.InterpolateMultipleFramesOnMesh(WorkMesh(),0,VertPos);
+
+            assert(VertPos.size()>0);
+            for (size_t frame=0;frame<VertPos.size();frame++)
+                for (size_t i=0;i<VertPos[frame].size();i++)
+                    WorkMesh().vert[i].FramePos.push_back(VertPos[frame][i]);
+        }
 
 //        for (size_t i=0;i<half_def_mesh.vert.size();i++)
 //            half_def_mesh.vert[i].FramePos.push_back(half_def_mesh.vert[i].P());
@@ -1088,20 +1509,29 @@ public:
 
         //std::cout<<"Test 0 there are :"<<half_def_mesh.vert[0].FramePos.size()<<" frames"<<std::endl;
 #endif
-        std::cout<<"TRACING"<<std::endl;
-        TracePatch(false,writeDebug);
+        if (Done<PSTrace)
+        {
+            std::cout<<"TRACING"<<std::endl;
+            TracePatch(false,writeDebug);
+            if (!checkpoint_prefix.empty())
+                SaveStage(PSTrace,CheckpointPath(PSTrace),TracePrint);
+        }
 
         std::cout<<"REMOVING SYMMETRY"<<std::endl;
         if (remove_along_symmetry)
             RemoveOnSymmetryPathIfPossible();
 
         std::cout<<"FINAL PARAMETRIZATION"<<std::endl;
-        size_t t3=clock();
+        ScalarType TimeTrace=TraceScope.Stop();
+        ProfileScope ParamScope("stage_param");
 #ifdef MULTI_FRAME
 
         //std::vector<std::vector<CoordType> > VertPos;
+        //without symmetry the traced mesh is this one, it already has frames
+        for (size_t i=0;i<deformed_mesh.vert.size();i++)
+            deformed_mesh.vert[i].FramePos.clear();
         if (useFrames)
-            AManager.InterpolateMultipleFramesOnMesh(deformed_mesh,3,VertPos);
+            AManager.InterpolateMultipleFramesOnMesh(deformed_mesh,frame_budget,VertPos,frame_selection);
         else
             AManager.InterpolateMultipleFramesOnMesh(deformed_mesh,0,VertPos);
 
@@ -1133,18 +1563,22 @@ public:
         //std::cout<<"Test 0 there are :"<<half_def_mesh.vert[0].FramePos.size()<<" frames"<<std::endl;
 #endif
         DoParametrize();
-        size_t t4=clock();
+        ScalarType TimeParam=ParamScope.Stop();
         if (writeTime)
         {
-            std::cout<<"Time Symmetrize:"<<(t1-t0)/(ScalarType)CLOCKS_PER_SEC<<std::endl;
-            std::cout<<"Time Field Computation:"<<(t2-t1)/(ScalarType)CLOCKS_PER_SEC<<std::endl;
-            std::cout<<"Time Patch Tracing:"<<(t3-t2)/(ScalarType)CLOCKS_PER_SEC<<std::endl;
-            std::cout<<"Time Parametrize:"<<(t4-t3)/(ScalarType)CLOCKS_PER_SEC<<std::endl;
+            std::cout<<"Time Symmetrize:"<<TimeSymm<<std::endl;
+            std::cout<<"Time Field Computation:"<<TimeField<<std::endl;
+            std::cout<<"Time Patch Tracing:"<<TimeTrace<<std::endl;
+            std::cout<<"Time Parametrize:"<<TimeParam<<std::endl;
         }
 
         #ifdef COUNT_PARAM_CALLS
-        std::cout << "#param calls: " << param_calls_count << std::endl;
+        std::cout << "#param calls: " << param_calls_count.load() << std::endl;
         #endif
+        if (cache_quality)
+            MeshArapQuality<TriMeshType>::Cache().PrintStats();
+        if (proxy_quality)
+            MeshArapQuality<TriMeshType>::Proxy().PrintStats();
     }
 
     ~Parafashion()
@@ -1176,13 +1610,27 @@ public:
         use_darts=false;
         allow_self_glue=true;
         remove_along_symmetry=false;
+        use_symmetry=true;
+        direct_symmetrization=false;
+        auto_symmetry_plane=false;
+        symmetry_plane=SymmetrizeDeformation<TriMeshType>::DefaultPlane();
         remesh_on_test=false;
+        param_threads=1;
+        cache_quality=false;
+        accept_seed_layout=false;
+        proxy_quality=false;
+        proxy_reduction=4;
+        proxy_margin=0.25;
+        resume_from=PSNone;
         UVMode=PMCloth;
         CheckUVIntersection=true;
         SmoothBeforeRemove=true;
         check_T_junction=true;
         final_removal=true;
         useFrames=false;
+        frame_budget=1;
+        frame_selection=FSCluster;
+        field_precision=FPDouble;
     }
 };
 
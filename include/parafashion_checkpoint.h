@@ -0,0 +1,335 @@
+#ifndef PARAFASHION_CHECKPOINT
+#define PARAFASHION_CHECKPOINT
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <vcg/complex/complex.h>
+#include <vcg/space/plane3.h>
+
+//stages of the pipeline after which the state can be saved and resumed
+enum PipelineStage{PSNone,PSField,PSTrace};
+
+//binary layout: magic, version, stage, sizeof(ScalarType), fingerprint of the
+//inputs and parameters, whether only half of the symmetrized mesh is
+//processed, symmetry plane (normal and offset), number of meshes, then for
+//each mesh the vertices and faces with everything computed so far (field
+//directions and magnitudes, quality, colors, UVs, selection and sharp flags,
+//singularities), then the corners of the traced patches
+#define CHECKPOINT_MAGIC "PFCK"
+#define CHECKPOINT_VERSION 5
+
+//order dependent hash of what a checkpoint was computed from,
+//a checkpoint is loaded only if the current inputs give the same value
+class CheckpointFingerprint
+{
+    uint64_t H;
+
+public:
+
+    void Add(uint64_t Val)
+    {
+        //splitmix64 step, as PatchQualityCache
+        H^=Val+0x9E3779B97F4A7C15ULL+(H<<6)+(H>>2);
+        H^=(H>>30);
+        H*=0xBF58476D1CE4E5B9ULL;
+        H^=(H>>27);
+        H*=0x94D049BB133111EBULL;
+        H^=(H>>31);
+    }
+
+    void AddScalar(double Val)
+    {
+        if (Val==0)Val=0;//-0 and +0 are the same
+        uint64_t Bits;
+        memcpy(&Bits,&Val,sizeof(double));
+        Add(Bits);
+    }
+
+    template <class TriMeshType>
+    void AddMesh(const TriMeshType &mesh)
+    {
+        Add(mesh.vert.size());
+        for (size_t i=0;i<mesh.vert.size();i++)
+            for (size_t j=0;j<3;j++)
+                AddScalar(mesh.vert[i].cP().V(j));
+        Add(mesh.face.size());
+        for (size_t i=0;i<mesh.face.size();i++)
+            for (size_t j=0;j<3;j++)
+                Add(vcg::tri::Index(mesh,mesh.face[i].cV(j)));
+    }
+
+    uint64_t Value()const{return H;}
+
+    CheckpointFingerprint():H(0x84222325CBF29CE4ULL){}
+};
+
+template <class ValType>
+void WriteCheckpointVal(FILE *f,const ValType &Val)
+{
+    fwrite(&Val,sizeof(ValType),1,f);
+}
+
+template <class ValType>
+bool ReadCheckpointVal(FILE *f,ValType &Val)
+{
+    return (fread(&Val,sizeof(ValType),1,f)==1);
+}
+
+template <class TriMeshType>
+void WriteCheckpointMesh(FILE *f,const TriMeshType &mesh)
+{
+    typedef typename TriMeshType::ScalarType ScalarType;
+
+    //the meshes of the pipeline are always compacted
+    assert((size_t)mesh.vn==mesh.vert.size());
+    assert((size_t)mesh.fn==mesh.face.size());
+
+    WriteCheckpointVal(f,(uint32_t)mesh.vert.size());
+    for (size_t i=0;i<mesh.vert.size();i++)
+    {
+        for (size_t j=0;j<3;j++)
+        {
+            WriteCheckpointVal(f,mesh.vert[i].cP().V(j));
+            WriteCheckpointVal(f,mesh.vert[i].cPD1().V(j));
+            WriteCheckpointVal(f,mesh.vert[i].cPD2().V(j));
+        }
+        WriteCheckpointVal(f,mesh.vert[i].cK1());
+        WriteCheckpointVal(f,mesh.vert[i].cK2());
+        WriteCheckpointVal(f,mesh.vert[i].cQ());
+        WriteCheckpointVal(f,mesh.vert[i].cT().P().X());
+        WriteCheckpointVal(f,mesh.vert[i].cT().P().Y());
+        WriteCheckpointVal(f,mesh.vert[i].cC());
+        WriteCheckpointVal(f,(int32_t)mesh.vert[i].cFlags());
+#ifdef MULTI_FRAME
+        WriteCheckpointVal(f,(uint32_t)mesh.vert[i].FramePos.size());
+        for (size_t j=0;j<mesh.vert[i].FramePos.size();j++)
+            for (size_t k=0;k<3;k++)
+                WriteCheckpointVal(f,mesh.vert[i].FramePos[j].V(k));
+#endif
+    }
+
+    WriteCheckpointVal(f,(uint32_t)mesh.face.size());
+    for (size_t i=0;i<mesh.face.size();i++)
+    {
+        for (size_t j=0;j<3;j++)
+        {
+            WriteCheckpointVal(f,(uint32_t)vcg::tri::Index(mesh,mesh.face[i].cV(j)));
+            WriteCheckpointVal(f,mesh.face[i].cPD1().V(j));
+            WriteCheckpointVal(f,mesh.face[i].cPD2().V(j));
+            WriteCheckpointVal(f,mesh.face[i].cWT(j).P().X());
+            WriteCheckpointVal(f,mesh.face[i].cWT(j).P().Y());
+        }
+        WriteCheckpointVal(f,mesh.face[i].cQ());
+        WriteCheckpointVal(f,mesh.face[i].cC());
+        WriteCheckpointVal(f,(int32_t)mesh.face[i].cFlags());
+    }
+
+    //singularities, as computed by CrossField::UpdateSingularByCross
+    bool HasSing=(vcg::tri::HasPerVertexAttribute(mesh,std::string("Singular"))&&
+                  vcg::tri::HasPerVertexAttribute(mesh,std::string("SingularIndex")));
+    WriteCheckpointVal(f,(uint8_t)HasSing);
+    if (!HasSing)return;
+
+    typename TriMeshType::template ConstPerVertexAttributeHandle<bool> Handle_Singular;
+    Handle_Singular=vcg::tri::Allocator<TriMeshType>::template FindPerVertexAttribute<bool>(mesh,std::string("Singular"));
+    typename TriMeshType::template ConstPerVertexAttributeHandle<int> Handle_SingularIndex;
+    Handle_SingularIndex=vcg::tri::Allocator<TriMeshType>::template FindPerVertexAttribute<int>(mesh,std::string("SingularIndex"));
+    for (size_t i=0;i<mesh.vert.size();i++)
+    {
+        WriteCheckpointVal(f,(uint8_t)Handle_Singular[i]);
+        WriteCheckpointVal(f,(int32_t)Handle_SingularIndex[i]);
+    }
+}
+
+template <class TriMeshType>
+bool ReadCheckpointMesh(FILE *f,TriMeshType &mesh)
+{
+    typedef typename TriMeshType::ScalarType ScalarType;
+    typedef typename TriMeshType::CoordType CoordType;
+
+    mesh.Clear();
+
+    uint32_t NumV;
+    if (!ReadCheckpointVal(f,NumV))return false;
+    vcg::tri::Allocator<TriMeshType>::AddVertices(mesh,NumV);
+    std::vector<int32_t> VertFlags(NumV);
+    for (size_t i=0;i<mesh.vert.size();i++)
+    {
+        bool Ok=true;
+        for (size_t j=0;j<3;j++)
+        {
+            Ok&=ReadCheckpointVal(f,mesh.vert[i].P().V(j));
+            Ok&=ReadCheckpointVal(f,mesh.vert[i].PD1().V(j));
+            Ok&=ReadCheckpointVal(f,mesh.vert[i].PD2().V(j));
+        }
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].K1());
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].K2());
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].Q());
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].T().P().X());
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].T().P().Y());
+        Ok&=ReadCheckpointVal(f,mesh.vert[i].C());
+        Ok&=ReadCheckpointVal(f,VertFlags[i]);
+#ifdef MULTI_FRAME
+        uint32_t NumFrames;
+        Ok&=ReadCheckpointVal(f,NumFrames);
+        mesh.vert[i].FramePos.resize(NumFrames);
+        for (size_t j=0;j<mesh.vert[i].FramePos.size();j++)
+            for (size_t k=0;k<3;k++)
+                Ok&=ReadCheckpointVal(f,mesh.vert[i].FramePos[j].V(k));
+#endif
+        if (!Ok)return false;
+    }
+
+    uint32_t NumF;
+    if (!ReadCheckpointVal(f,NumF))return false;
+    vcg::tri::Allocator<TriMeshType>::AddFaces(mesh,NumF);
+    std::vector<int32_t> FaceFlags(NumF);
+    for (size_t i=0;i<mesh.face.size();i++)
+    {
+        bool Ok=true;
+        for (size_t j=0;j<3;j++)
+        {
+            uint32_t IndexV;
+            Ok&=ReadCheckpointVal(f,IndexV);
+            if ((!Ok)||(IndexV>=NumV))return false;
+            mesh.face[i].V(j)=&mesh.vert[IndexV];
+            Ok&=ReadCheckpointVal(f,mesh.face[i].PD1().V(j));
+            Ok&=ReadCheckpointVal(f,mesh.face[i].PD2().V(j));
+            Ok&=ReadCheckpointVal(f,mesh.face[i].WT(j).P().X());
+            Ok&=ReadCheckpointVal(f,mesh.face[i].WT(j).P().Y());
+        }
+        Ok&=ReadCheckpointVal(f,mesh.face[i].Q());
+        Ok&=ReadCheckpointVal(f,mesh.face[i].C());
+        Ok&=ReadCheckpointVal(f,FaceFlags[i]);
+        if (!Ok)return false;
+    }
+
+    //update topology and normals, then put back the saved flags
+    //(selection, sharp edges) that the update may have overwritten
+    mesh.UpdateAttributes();
+    for (size_t i=0;i<mesh.vert.size();i++)
+        mesh.vert[i].Flags()=VertFlags[i];
+    for (size_t i=0;i<mesh.face.size();i++)
+        mesh.face[i].Flags()=FaceFlags[i];
+
+    uint8_t HasSing;
+    if (!ReadCheckpointVal(f,HasSing))return false;
+    if (!HasSing)return true;
+
+    typename TriMeshType::template PerVertexAttributeHandle<bool> Handle_Singular;
+    Handle_Singular=vcg::tri::Allocator<TriMeshType>::template GetPerVertexAttribute<bool>(mesh,std::string("Singular"));
+    typename TriMeshType::template PerVertexAttributeHandle<int> Handle_SingularIndex;
+    Handle_SingularIndex=vcg::tri::Allocator<TriMeshType>::template GetPerVertexAttribute<int>(mesh,std::string("SingularIndex"));
+    for (size_t i=0;i<mesh.vert.size();i++)
+    {
+        uint8_t Sing;
+        int32_t SingIndex;
+        if (!ReadCheckpointVal(f,Sing))return false;
+        if (!ReadCheckpointVal(f,SingIndex))return false;
+        Handle_Singular[i]=(Sing!=0);
+        Handle_SingularIndex[i]=SingIndex;
+    }
+    return true;
+}
+
+template <class TriMeshType>
+bool SaveCheckpoint(const std::string &path,
+                    PipelineStage Stage,
+                    uint64_t Fingerprint,
+                    bool UseSymmetry,
+                    const vcg::Plane3<typename TriMeshType::ScalarType> &Plane,
+                    const std::vector<const TriMeshType*> &Meshes,
+                    const std::vector<typename TriMeshType::CoordType> &Corners)
+{
+    FILE *f=fopen(path.c_str(),"wb");
+    if (f==NULL)return false;
+
+    fwrite(CHECKPOINT_MAGIC,1,4,f);
+    WriteCheckpointVal(f,(uint32_t)CHECKPOINT_VERSION);
+    WriteCheckpointVal(f,(uint32_t)Stage);
+    WriteCheckpointVal(f,(uint32_t)sizeof(typename TriMeshType::ScalarType));
+    WriteCheckpointVal(f,Fingerprint);
+    WriteCheckpointVal(f,(uint8_t)UseSymmetry);
+    for (size_t j=0;j<3;j++)
+        WriteCheckpointVal(f,(double)Plane.Direction().V(j));
+    WriteCheckpointVal(f,(double)Plane.Offset());
+    WriteCheckpointVal(f,(uint32_t)Meshes.size());
+    for (size_t i=0;i<Meshes.size();i++)
+        WriteCheckpointMesh(f,*Meshes[i]);
+    WriteCheckpointVal(f,(uint32_t)Corners.size());
+    for (size_t i=0;i<Corners.size();i++)
+        for (size_t j=0;j<3;j++)
+            WriteCheckpointVal(f,Corners[i].V(j));
+
+    bool Ok=(ferror(f)==0);
+    fclose(f);
+    return Ok;
+}
+
+//fails if the file was saved for another stage, from other inputs
+//(Fingerprint differs) or with(out) UseSymmetry, the meshes are then left
+//as they are; it also fails on a truncated or corrupted file, but then the
+//meshes read before the error have already been overwritten, so the caller
+//must restore them;
+//Plane gets the symmetry plane the state was computed with, Corners the
+//corners of the traced patches
+template <class TriMeshType>
+bool LoadCheckpoint(const std::string &path,
+                    PipelineStage Stage,
+                    uint64_t Fingerprint,
+                    bool UseSymmetry,
+                    vcg::Plane3<typename TriMeshType::ScalarType> &Plane,
+                    const std::vector<TriMeshType*> &Meshes,
+                    std::vector<typename TriMeshType::CoordType> &Corners)
+{
+    FILE *f=fopen(path.c_str(),"rb");
+    if (f==NULL)return false;
+
+    char Magic[4];
+    uint32_t Version,FileStage,ScalarSize,NumMeshes,NumCorners;
+    uint64_t FileFingerprint;
+    uint8_t FileUseSymmetry;
+    double PlaneVal[4];
+    bool Ok=(fread(Magic,1,4,f)==4);
+    Ok=Ok&&(memcmp(Magic,CHECKPOINT_MAGIC,4)==0);
+    Ok=Ok&&ReadCheckpointVal(f,Version)&&(Version==CHECKPOINT_VERSION);
+    Ok=Ok&&ReadCheckpointVal(f,FileStage)&&(FileStage==(uint32_t)Stage);
+    Ok=Ok&&ReadCheckpointVal(f,ScalarSize)&&(ScalarSize==sizeof(typename TriMeshType::ScalarType));
+    Ok=Ok&&ReadCheckpointVal(f,FileFingerprint);
+    if ((Ok)&&(FileFingerprint!=Fingerprint))
+    {
+        std::cout<<"Checkpoint computed from other inputs or parameters"<<std::endl;
+        Ok=false;
+    }
+    Ok=Ok&&ReadCheckpointVal(f,FileUseSymmetry);
+    if ((Ok)&&((FileUseSymmetry!=0)!=UseSymmetry))
+    {
+        std::cout<<"Checkpoint computed "<<(UseSymmetry?"on the full mesh":"on half of the mesh")<<std::endl;
+        Ok=false;
+    }
+    for (size_t j=0;j<4;j++)
+        Ok=Ok&&ReadCheckpointVal(f,PlaneVal[j]);
+    Ok=Ok&&ReadCheckpointVal(f,NumMeshes)&&(NumMeshes==Meshes.size());
+    for (size_t i=0;(Ok)&&(i<Meshes.size());i++)
+        Ok=ReadCheckpointMesh(f,*Meshes[i]);
+    Ok=Ok&&ReadCheckpointVal(f,NumCorners);
+    if (Ok)Corners.resize(NumCorners);
+    for (size_t i=0;(Ok)&&(i<Corners.size());i++)
+        for (size_t j=0;j<3;j++)
+            Ok=Ok&&ReadCheckpointVal(f,Corners[i].V(j));
+
+    if (Ok)
+    {
+        typedef typename TriMeshType::ScalarType ScalarType;
+        Plane.Set(vcg::Point3<ScalarType>(PlaneVal[0],PlaneVal[1],PlaneVal[2]),
+                  (ScalarType)PlaneVal[3]);
+    }
+    fclose(f);
+    return Ok;
+}
+
+#endif
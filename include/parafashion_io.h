@@ -0,0 +1,109 @@
+#ifndef PARAFASHION_IO
+#define PARAFASHION_IO
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/clean.h>
+#include <wrap/io_trimesh/export.h>
+
+//the constraints file has the same layout as the frames one:
+//first the number of polylines then, for each polyline,
+//the number of points followed by one "x,y,z" point per line
+template <class CoordType>
+bool LoadConstraintPolylines(const std::string &path,
+                             std::vector<std::vector<CoordType> > &PickedPoints)
+{
+    PickedPoints.clear();
+
+    FILE *f=fopen(path.c_str(),"rt");
+    if (f==NULL)return false;
+
+    int NumPolyL;
+    if (fscanf(f,"%d\n",&NumPolyL)!=1)
+    {
+        fclose(f);
+        return false;
+    }
+
+    PickedPoints.resize(NumPolyL);
+    for (size_t i=0;i<PickedPoints.size();i++)
+    {
+        int NumPoints;
+        if (fscanf(f,"%d\n",&NumPoints)!=1)
+        {
+            fclose(f);
+            return false;
+        }
+        for (int j=0;j<NumPoints;j++)
+        {
+            float XPos,YPos,ZPos;
+            if (fscanf(f,"%f,%f,%f\n",&XPos,&YPos,&ZPos)!=3)
+            {
+                fclose(f);
+                return false;
+            }
+            PickedPoints[i].push_back(CoordType(XPos,YPos,ZPos));
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+template <class TriMeshType>
+void SavePatchMesh(const TriMeshType &mesh,
+                   const std::string &path,
+                   const typename TriMeshType::CoordType &Center)
+{
+    TriMeshType saveM;
+    vcg::tri::Append<TriMeshType,TriMeshType>::MeshCopyConst(saveM,mesh);
+
+    vcg::tri::Clean<TriMeshType>::RemoveDuplicateVertex(saveM);
+
+    for (size_t i=0;i<saveM.vert.size();i++)
+        saveM.vert[i].P()+=Center;
+
+    saveM.UpdateAttributes();
+    vcg::tri::io::ExporterOBJ<TriMeshType>::Save(saveM,path.c_str(),
+                                                 vcg::tri::io::Mask::IOM_WEDGTEXCOORD|
+                                                 vcg::tri::io::Mask::IOM_FACECOLOR);
+}
+
+template <class TriMeshType>
+bool SavePatchPartition(const TriMeshType &mesh,
+                        const std::string &path)
+{
+    FILE *F=fopen(path.c_str(),"wt");
+    if (F==NULL)return false;
+    fprintf(F,"%d\n",(int)mesh.face.size());
+    for (size_t i=0;i<mesh.face.size();i++)
+        fprintf(F,"%d\n",(int)mesh.face[i].cQ());
+    fclose(F);
+    return true;
+}
+
+template <class TriMeshType>
+bool SavePerWedgeUV(const TriMeshType &mesh,
+                    const std::string &path)
+{
+    typedef typename TriMeshType::ScalarType ScalarType;
+
+    FILE *F=fopen(path.c_str(),"wt");
+    if (F==NULL)return false;
+    fprintf(F,"%d\n",(int)mesh.face.size());
+    for (size_t i=0;i<mesh.face.size();i++)
+    {
+        vcg::Point2<ScalarType> T0=mesh.face[i].cWT(0).P();
+        vcg::Point2<ScalarType> T1=mesh.face[i].cWT(1).P();
+        vcg::Point2<ScalarType> T2=mesh.face[i].cWT(2).P();
+        fprintf(F,"%f,%f;%f,%f;%f,%f\n",
+                T0.X(),T0.Y(),
+                T1.X(),T1.Y(),
+                T2.X(),T2.Y());
+    }
+    fclose(F);
+    return true;
+}
+
+#endif
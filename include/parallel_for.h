@@ -0,0 +1,77 @@
+#ifndef PARALLEL_FOR
+#define PARALLEL_FOR
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+//number of worker threads to use, 0 means one per hardware core
+inline size_t NumWorkerThreads(size_t num_threads=0)
+{
+    if (num_threads==0)
+        num_threads=std::thread::hardware_concurrency();
+    return std::max(num_threads,(size_t)1);
+}
+
+//run Job(i) for every i in [0,Size) on a pool of num_threads workers,
+//each worker takes the next index as soon as it is done with the previous one,
+//so jobs of very different cost get balanced; with one thread it runs in order
+template <class JobType>
+void ParallelFor(size_t Size,
+                 size_t num_threads,
+                 JobType Job)
+{
+    num_threads=std::min(NumWorkerThreads(num_threads),Size);
+    if (num_threads<=1)
+    {
+        for (size_t i=0;i<Size;i++)
+            Job(i);
+        return;
+    }
+
+    std::atomic<size_t> NextJob(0);
+    auto Worker=[&]()
+    {
+        size_t i;
+        while ((i=NextJob++)<Size)
+            Job(i);
+    };
+
+    std::vector<std::thread> Pool;
+    for (size_t t=1;t<num_threads;t++)
+        Pool.push_back(std::thread(Worker));
+    Worker();
+    for (size_t t=0;t<Pool.size();t++)
+        Pool[t].join();
+}
+
+//same as above, but Job(Begin,End,IndexThread) gets a contiguous range of indices,
+//useful when each worker needs its own scratch data
+template <class JobType>
+void ParallelForRange(size_t Size,
+                      size_t num_threads,
+                      JobType Job)
+{
+    num_threads=std::min(NumWorkerThreads(num_threads),Size);
+    if (num_threads<=1)
+    {
+        if (Size>0)
+            Job((size_t)0,Size,(size_t)0);
+        return;
+    }
+
+    size_t Chunk=(Size+num_threads-1)/num_threads;
+    std::vector<std::thread> Pool;
+    for (size_t t=0;t<num_threads;t++)
+    {
+        size_t Begin=t*Chunk;
+        size_t End=std::min(Begin+Chunk,Size);
+        if (Begin>=End)break;
+        Pool.push_back(std::thread(Job,Begin,End,t));
+    }
+    for (size_t t=0;t<Pool.size();t++)
+        Pool[t].join();
+}
+
+#endif
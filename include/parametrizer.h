@@ -8,6 +8,10 @@
 #include <vcg/complex/algorithms/parametrization/uv_utils.h>
 #include <tracing/patch_manager.h>
 #include <vcg/complex/algorithms/mesh_to_matrix.h>
+#include <vcg/space/intersection2.h>
+#include <vcg/space/box2.h>
+#include "profiler.h"
+#include "parallel_for.h"
 #include <param/cloth_param.h>
 #include <param/multi_patch_param.h>
 #include <param/metrics.h>
@@ -39,6 +43,8 @@ bool ClothParametrize(TriMeshType &mesh,
                       bool SelfIntCheck,
                       bool &DoIntersectUV)
 {
+    PARAFASHION_PROFILE("cloth_param");
+
     typedef typename TriMeshType::CoordType CoordType;
     Eigen::MatrixXd V;
     Eigen::MatrixXi F;
@@ -105,6 +111,7 @@ bool ClothParametrize(TriMeshType &mesh,
         mesh.vert[i].T().P()[1] = V_uv(i,1);
     }
 
+    //same measure of the solver, so the out of bound faces agree with success
     Eigen::VectorXd stretch_u_vec,stretch_v_vec;
     measureStretchScore(V_uv,V, F,stretch_u_vec,stretch_v_vec);
 
@@ -136,6 +143,139 @@ bool ClothParametrize(TriMeshType &mesh,
 #endif
 }
 
+//range of the per face stretch of the final per wedge parametrization
+template <class TriMeshType>
+void MeshStretchRange(const TriMeshType &mesh,
+                      typename TriMeshType::ScalarType &MinStretch,
+                      typename TriMeshType::ScalarType &MaxStretch)
+{
+    //one vertex per wedge, so seams do not matter
+    Eigen::MatrixXd V(mesh.face.size()*3,3);
+    Eigen::MatrixXd V_uv(mesh.face.size()*3,2);
+    Eigen::MatrixXi F(mesh.face.size(),3);
+    for (size_t i=0;i<mesh.face.size();i++)
+        for (size_t j=0;j<3;j++)
+        {
+            size_t IndexV=i*3+j;
+            F(i,j)=IndexV;
+            for (size_t k=0;k<3;k++)
+                V(IndexV,k)=mesh.face[i].cP(j).V(k);
+            V_uv(IndexV,0)=mesh.face[i].cWT(j).P().X();
+            V_uv(IndexV,1)=mesh.face[i].cWT(j).P().Y();
+        }
+
+    MinStretch=0;
+    MaxStretch=0;
+    if (mesh.face.size()==0)return;
+
+    Eigen::VectorXd stretch_u_vec,stretch_v_vec;
+    measureStretchScore(V_uv,V,F,stretch_u_vec,stretch_v_vec);
+    MinStretch=std::min(stretch_u_vec.minCoeff(),stretch_v_vec.minCoeff());
+    MaxStretch=std::max(stretch_u_vec.maxCoeff(),stretch_v_vec.maxCoeff());
+}
+
+//check if a given layout (e.g. assembled from already flattened patches)
+//is already a valid cloth parametrization: no flipped faces, stretch inside
+//the bounds and, if requested, no intersections of the UV boundary;
+//if so it is copied on the mesh and the solve can be skipped, the layout is
+//not used to initialize the solver otherwise
+template <class TriMeshType>
+bool AcceptClothSeed(TriMeshType &mesh,
+                     const Eigen::MatrixXd &V_uv,
+                     typename TriMeshType::ScalarType MinQ,
+                     typename TriMeshType::ScalarType MaxQ,
+                     bool SelfIntCheck)
+{
+    typedef typename TriMeshType::ScalarType ScalarType;
+
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    vcg::tri::MeshToMatrix<TriMeshType>::GetTriMeshData(mesh, F, V);
+    assert(V_uv.rows()==V.rows());
+
+    //all the faces must have the same orientation
+    int Sign=0;
+    for (int i=0;i<F.rows();i++)
+    {
+        vcg::Point2d T0(V_uv(F(i,0),0),V_uv(F(i,0),1));
+        vcg::Point2d T1(V_uv(F(i,1),0),V_uv(F(i,1),1));
+        vcg::Point2d T2(V_uv(F(i,2),0),V_uv(F(i,2),1));
+        double Area=(T1-T0)^(T2-T0);
+        if (Area==0)return false;
+        int CurrSign=(Area>0)?1:-1;
+        if (Sign==0)Sign=CurrSign;
+        if (CurrSign!=Sign)return false;
+    }
+
+    Eigen::VectorXd stretch_u_vec,stretch_v_vec;
+    measureStretchScore(V_uv,V, F,stretch_u_vec,stretch_v_vec);
+    for (int i=0;i<F.rows();i++)
+    {
+        if ((stretch_u_vec(i)<MinQ)||(stretch_u_vec(i)>MaxQ))return false;
+        if ((stretch_v_vec(i)<MinQ)||(stretch_v_vec(i)>MaxQ))return false;
+    }
+
+    if (SelfIntCheck)
+    {
+        //border edges are the ones referenced by a single face
+        std::map<std::pair<int,int>,int> EdgeCount;
+        for (int i=0;i<F.rows();i++)
+            for (int j=0;j<3;j++)
+            {
+                int IndexV0=F(i,j);
+                int IndexV1=F(i,(j+1)%3);
+                EdgeCount[std::pair<int,int>(std::min(IndexV0,IndexV1),
+                                             std::max(IndexV0,IndexV1))]++;
+            }
+        std::vector<std::pair<int,int> > BorderE;
+        typename std::map<std::pair<int,int>,int>::const_iterator IteE;
+        for (IteE=EdgeCount.begin();IteE!=EdgeCount.end();IteE++)
+            if ((*IteE).second==1)BorderE.push_back((*IteE).first);
+
+        //sort and sweep along u, only the edges whose u ranges overlap
+        //are tested against each other
+        std::vector<vcg::Box2d> BorderBox(BorderE.size());
+        std::vector<std::pair<double,size_t> > SortedE(BorderE.size());
+        for (size_t i=0;i<BorderE.size();i++)
+        {
+            BorderBox[i].Set(vcg::Point2d(V_uv(BorderE[i].first,0),V_uv(BorderE[i].first,1)));
+            BorderBox[i].Add(vcg::Point2d(V_uv(BorderE[i].second,0),V_uv(BorderE[i].second,1)));
+            SortedE[i]=std::pair<double,size_t>(BorderBox[i].min.X(),i);
+        }
+        std::sort(SortedE.begin(),SortedE.end());
+
+        for (size_t i=0;i<SortedE.size();i++)
+            for (size_t j=i+1;j<SortedE.size();j++)
+            {
+                size_t IndexE0=SortedE[i].second;
+                size_t IndexE1=SortedE[j].second;
+                if (SortedE[j].first>BorderBox[IndexE0].max.X())break;
+                if (BorderBox[IndexE1].min.Y()>BorderBox[IndexE0].max.Y())continue;
+                if (BorderBox[IndexE0].min.Y()>BorderBox[IndexE1].max.Y())continue;
+
+                const std::pair<int,int> &E0=BorderE[IndexE0];
+                const std::pair<int,int> &E1=BorderE[IndexE1];
+                //consecutive edges share a vertex
+                if ((E0.first==E1.first)||(E0.first==E1.second)||
+                    (E0.second==E1.first)||(E0.second==E1.second))continue;
+
+                vcg::Segment2d Seg0(vcg::Point2d(V_uv(E0.first,0),V_uv(E0.first,1)),
+                                    vcg::Point2d(V_uv(E0.second,0),V_uv(E0.second,1)));
+                vcg::Segment2d Seg1(vcg::Point2d(V_uv(E1.first,0),V_uv(E1.first,1)),
+                                    vcg::Point2d(V_uv(E1.second,0),V_uv(E1.second,1)));
+                vcg::Point2d IntP;
+                if (vcg::SegmentSegmentIntersection(Seg0,Seg1,IntP))return false;
+            }
+    }
+
+    for (int i=0; i<(int)mesh.vert.size(); i++)
+    {
+        mesh.vert[i].T().P()[0] = (ScalarType)V_uv(i,0);
+        mesh.vert[i].T().P()[1] = (ScalarType)V_uv(i,1);
+    }
+    return true;
+}
+
 
 template <class TriMeshType>
 class Parametrizer
@@ -341,33 +481,37 @@ class Parametrizer
 
 public:
 
+    //a single call of the library measure on all the faces, each face with
+    //its own three vertices so the wedge UVs of seams are kept apart
     static void SetQasClothDistorsion(TriMeshType &mesh)
     {
-        for (size_t i=0;i<mesh.face.size();i++)
-        {
-            Eigen::MatrixXd V_2d(3, 3);
-            Eigen::MatrixXd V_3d(3, 3);
-            Eigen::MatrixXi F(1, 3);
-            Eigen::VectorXd stretch_u_vec,stretch_v_vec;
+        if (mesh.face.size()==0)return;
+
+        Eigen::MatrixXd V_2d(mesh.face.size()*3,3);
+        Eigen::MatrixXd V_3d(mesh.face.size()*3,3);
+        Eigen::MatrixXi F(mesh.face.size(),3);
+        Eigen::VectorXd stretch_u_vec,stretch_v_vec;
 
+        for (size_t i=0;i<mesh.face.size();i++)
             for (size_t j=0;j<3;j++)
             {
-                V_2d(j,0)=mesh.face[i].WT(j).P().X();
-                V_2d(j,1)=mesh.face[i].WT(j).P().Y();
-                V_2d(j,2)=0;
+                size_t IndexV=i*3+j;
+                V_2d(IndexV,0)=mesh.face[i].WT(j).P().X();
+                V_2d(IndexV,1)=mesh.face[i].WT(j).P().Y();
+                V_2d(IndexV,2)=0;
 
-                V_3d(j,0)=mesh.face[i].V(j)->P().X();
-                V_3d(j,1)=mesh.face[i].V(j)->P().Y();
-                V_3d(j,2)=mesh.face[i].V(j)->P().Z();
+                V_3d(IndexV,0)=mesh.face[i].V(j)->P().X();
+                V_3d(IndexV,1)=mesh.face[i].V(j)->P().Y();
+                V_3d(IndexV,2)=mesh.face[i].V(j)->P().Z();
 
-                F(0,j)=j;
+                F(i,j)=(int)IndexV;
             }
 
-            measureStretchScore(V_2d,V_3d,F,stretch_u_vec,stretch_v_vec);
-            ScalarType V0=stretch_u_vec(0);
-            ScalarType V1=stretch_v_vec(0);
-            std::cout<<"V0"<<V0<<std::endl;
-            std::cout<<"V1"<<V1<<std::endl;
+        measureStretchScore(V_2d,V_3d,F,stretch_u_vec,stretch_v_vec);
+        for (size_t i=0;i<mesh.face.size();i++)
+        {
+            ScalarType V0=stretch_u_vec(i);
+            ScalarType V1=stretch_v_vec(i);
             if (fabs(V0)>fabs(V1))
                 mesh.face[i].Q()=V0;
             else
@@ -579,7 +723,8 @@ public:
                             std::vector<int> &DartTipVert,
                             bool continuity_seams,
                             bool continuity_darts,
-                            ScalarType BorderPatch=0)
+                            ScalarType BorderPatch=0,
+                            size_t num_threads=1)
     {
         MergeAcrossBoundarySeams(mesh);
         //        std::vector<TriMeshType*> SubMeshes;
@@ -591,24 +736,22 @@ public:
 
         ScalarType A=0;
 
-        if (UVMode==PMConformal)
+        //the sub meshes are independent, the areas are summed afterwards
+        //in patch order so the result does not depend on the threads
+        if ((UVMode==PMConformal)||(UVMode==PMArap))
         {
-            for (size_t i=0;i<SubMeshes.size();i++)
+            std::vector<ScalarType> PatchA(SubMeshes.size(),0);
+            ParallelFor(SubMeshes.size(),num_threads,[&](size_t i)
             {
                 (*SubMeshes[i]).UpdateAttributes();
-                vcg::tri::InitializeArapWithLSCM((*SubMeshes[i]),0);
-                A+=vcg::tri::UV_Utils<TriMeshType>::PerVertUVArea(*SubMeshes[i]);
-            }
-        }
-
-        if (UVMode==PMArap)
-        {
-            for (size_t i=0;i<SubMeshes.size();i++)
-            {
-                (*SubMeshes[i]).UpdateAttributes();
-                vcg::tri::OptimizeUV_ARAP((*SubMeshes[i]),100,0,true);
-                A+=vcg::tri::UV_Utils<TriMeshType>::PerVertUVArea(*SubMeshes[i]);
-            }
+                if (UVMode==PMConformal)
+                    vcg::tri::InitializeArapWithLSCM((*SubMeshes[i]),0);
+                else
+                    vcg::tri::OptimizeUV_ARAP((*SubMeshes[i]),100,0,true);
+                PatchA[i]=vcg::tri::UV_Utils<TriMeshType>::PerVertUVArea(*SubMeshes[i]);
+            });
+            for (size_t i=0;i<PatchA.size();i++)
+                A+=PatchA[i];
         }
 
         if (UVMode==PMCloth)
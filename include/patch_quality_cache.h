@@ -0,0 +1,214 @@
+#ifndef PATCH_QUALITY_CACHE
+#define PATCH_QUALITY_CACHE
+
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+//memoize the result of the patch quality check, the key is an order independent
+//hash of the faces of the patch and of its boundary edges (so the same faces
+//cut in a different way give another key) plus the parameters used to evaluate it
+template <class ScalarType>
+class PatchQualityCache
+{
+public:
+
+    struct KeyType
+    {
+        uint64_t H0,H1;
+        size_t NumF;
+
+        bool operator ==(const KeyType &K)const
+        {return ((H0==K.H0)&&(H1==K.H1)&&(NumF==K.NumF));}
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const KeyType &K)const
+        {return (size_t)(K.H0^(K.H1*0x9E3779B97F4A7C15ULL));}
+    };
+
+private:
+
+    std::unordered_map<KeyType,ScalarType,KeyHash> Stored;
+    mutable std::mutex Lock;
+    size_t NumLookup;
+    size_t NumHit;
+
+    static uint64_t Mix(uint64_t h,uint64_t v)
+    {
+        //splitmix64 step
+        h^=v+0x9E3779B97F4A7C15ULL+(h<<6)+(h>>2);
+        h^=(h>>30);
+        h*=0xBF58476D1CE4E5B9ULL;
+        h^=(h>>27);
+        h*=0x94D049BB133111EBULL;
+        h^=(h>>31);
+        return h;
+    }
+
+    template <class CoordType>
+    static void HashPoints(CoordType *P,size_t Num,uint64_t &h0,uint64_t &h1)
+    {
+        std::sort(P,P+Num);
+        for (size_t j=0;j<Num;j++)
+            for (size_t k=0;k<3;k++)
+            {
+                h0=Mix(h0,Bits(P[j].V(k)));
+                h1=Mix(h1^0xA5A5A5A5A5A5A5A5ULL,Bits(P[j].V(k)));
+            }
+    }
+
+    static uint64_t Bits(double val)
+    {
+        if (val==0)val=0;//-0 and +0 are the same
+        uint64_t b;
+        memcpy(&b,&val,sizeof(double));
+        return b;
+    }
+
+public:
+
+    template <class MeshType,class ParamType>
+    static KeyType ComputeKey(const MeshType &m,const ParamType &Params)
+    {
+        typedef typename MeshType::CoordType CoordType;
+
+        //one hash per face, independent from the vertex order in the face
+        std::vector<uint64_t> FaceH0,FaceH1;
+        FaceH0.reserve(m.face.size());
+        FaceH1.reserve(m.face.size());
+        //edges of a single face, by vertex index, so split vertices count
+        std::map<std::pair<size_t,size_t>,size_t> EdgeCount;
+        for (size_t i=0;i<m.face.size();i++)
+        {
+            if (m.face[i].IsD())continue;
+            CoordType P[3]={m.face[i].cP(0),m.face[i].cP(1),m.face[i].cP(2)};
+            uint64_t h0=0x84222325CBF29CE4ULL;
+            uint64_t h1=0x1000193AF4B1B3ULL;
+            HashPoints(P,3,h0,h1);
+            FaceH0.push_back(h0);
+            FaceH1.push_back(h1);
+            for (size_t j=0;j<3;j++)
+            {
+                size_t IndexV0=m.face[i].cV(j)-&m.vert[0];
+                size_t IndexV1=m.face[i].cV((j+1)%3)-&m.vert[0];
+                EdgeCount[std::pair<size_t,size_t>(std::min(IndexV0,IndexV1),
+                                                   std::max(IndexV0,IndexV1))]++;
+            }
+        }
+        //boundary edges by position, a cut appears as two of them
+        std::vector<uint64_t> EdgeH0,EdgeH1;
+        std::map<std::pair<size_t,size_t>,size_t>::const_iterator IteE;
+        for (IteE=EdgeCount.begin();IteE!=EdgeCount.end();IteE++)
+        {
+            if ((*IteE).second!=1)continue;
+            CoordType P[2]={m.vert[(*IteE).first.first].cP(),
+                            m.vert[(*IteE).first.second].cP()};
+            uint64_t h0=0x5BD1E9955BD1E995ULL;
+            uint64_t h1=0xC6A4A7935BD1E995ULL;
+            HashPoints(P,2,h0,h1);
+            EdgeH0.push_back(h0);
+            EdgeH1.push_back(h1);
+        }
+        //the patch is a set of faces, so the order does not matter
+        std::sort(FaceH0.begin(),FaceH0.end());
+        std::sort(FaceH1.begin(),FaceH1.end());
+        std::sort(EdgeH0.begin(),EdgeH0.end());
+        std::sort(EdgeH1.begin(),EdgeH1.end());
+
+        KeyType K;
+        K.NumF=FaceH0.size();
+        K.H0=Mix(0,(uint64_t)Params.UVMode);
+        K.H0=Mix(K.H0,Bits(Params.MinQ));
+        K.H0=Mix(K.H0,Bits(Params.MaxQ));
+        K.H0=Mix(K.H0,(uint64_t)Params.RemeshOnTest);
+        K.H0=Mix(K.H0,(uint64_t)Params.ContinuousCheckSelfInt);
+        K.H0=Mix(K.H0,(uint64_t)Params.AcceptSeedLayout);
+        K.H0=Mix(K.H0,(uint64_t)Params.UseProxy);
+        K.H0=Mix(K.H0,Bits(Params.ProxyMargin));
+        K.H1=K.H0;
+        for (size_t i=0;i<FaceH0.size();i++)
+        {
+            K.H0=Mix(K.H0,FaceH0[i]);
+            K.H1=Mix(K.H1^0x5A5A5A5A5A5A5A5AULL,FaceH1[i]);
+        }
+        K.H0=Mix(K.H0,EdgeH0.size());
+        K.H1=Mix(K.H1,EdgeH1.size());
+        for (size_t i=0;i<EdgeH0.size();i++)
+        {
+            K.H0=Mix(K.H0,EdgeH0[i]);
+            K.H1=Mix(K.H1^0x5A5A5A5A5A5A5A5AULL,EdgeH1[i]);
+        }
+        return K;
+    }
+
+    bool Find(const KeyType &K,ScalarType &Val)
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        NumLookup++;
+        typename std::unordered_map<KeyType,ScalarType,KeyHash>::const_iterator IteK=Stored.find(K);
+        if (IteK==Stored.end())return false;
+        NumHit++;
+        Val=(*IteK).second;
+        return true;
+    }
+
+    void Insert(const KeyType &K,const ScalarType &Val)
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Stored[K]=Val;
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Stored.clear();
+        NumLookup=0;
+        NumHit=0;
+    }
+
+    size_t Size()const
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        return Stored.size();
+    }
+
+    size_t Lookups()const
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        return NumLookup;
+    }
+
+    size_t Hits()const
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        return NumHit;
+    }
+
+    ScalarType HitRate()const
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        if (NumLookup==0)return 0;
+        return ((ScalarType)NumHit/(ScalarType)NumLookup);
+    }
+
+    void PrintStats()const
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        ScalarType Rate=0;
+        if (NumLookup>0)
+            Rate=(ScalarType)NumHit/(ScalarType)NumLookup;
+        std::cout<<"Quality cache: "<<NumHit<<" hits over "<<NumLookup<<" lookups ";
+        std::cout<<"(hit rate "<<Rate*100<<"%), "<<Stored.size()<<" stored patches"<<std::endl;
+    }
+
+    PatchQualityCache():NumLookup(0),NumHit(0){}
+};
+
+#endif
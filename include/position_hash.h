@@ -0,0 +1,74 @@
+#ifndef POSITION_HASH
+#define POSITION_HASH
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+//points hashed on a uniform grid of cell CellSize, stored as a sorted array
+//of (hash,index) pairs; finds the closest point within a distance <=CellSize
+//by looking at the 27 cells around the query
+template <class CoordType>
+class PositionHash
+{
+    typedef typename CoordType::ScalarType ScalarType;
+
+    std::vector<std::pair<uint64_t,size_t> > Entries;
+    std::vector<CoordType> Points;
+    ScalarType CellSize;
+
+    int64_t Cell(ScalarType Val)const
+    {
+        return (int64_t)std::floor(Val/CellSize);
+    }
+
+    static uint64_t Hash(int64_t X,int64_t Y,int64_t Z)
+    {
+        return ((uint64_t)X*73856093ULL)^((uint64_t)Y*19349663ULL)^((uint64_t)Z*83492791ULL);
+    }
+
+public:
+
+    void Build(const std::vector<CoordType> &_Points,ScalarType _CellSize)
+    {
+        Points=_Points;
+        CellSize=_CellSize;
+        Entries.resize(Points.size());
+        for (size_t i=0;i<Points.size();i++)
+            Entries[i]=std::make_pair(Hash(Cell(Points[i].X()),
+                                           Cell(Points[i].Y()),
+                                           Cell(Points[i].Z())),i);
+        std::sort(Entries.begin(),Entries.end());
+    }
+
+    //index of the closest point within Tol (<=CellSize), -1 if none
+    int Closest(const CoordType &Pos,ScalarType Tol)const
+    {
+        int64_t CX=Cell(Pos.X()),CY=Cell(Pos.Y()),CZ=Cell(Pos.Z());
+        ScalarType BestD=Tol;
+        int Best=-1;
+        for (int64_t X=CX-1;X<=CX+1;X++)
+            for (int64_t Y=CY-1;Y<=CY+1;Y++)
+                for (int64_t Z=CZ-1;Z<=CZ+1;Z++)
+                {
+                    uint64_t Key=Hash(X,Y,Z);
+                    typename std::vector<std::pair<uint64_t,size_t> >::const_iterator It;
+                    It=std::lower_bound(Entries.begin(),Entries.end(),
+                                        std::make_pair(Key,(size_t)0));
+                    for (;(It!=Entries.end())&&(It->first==Key);It++)
+                    {
+                        ScalarType D=(Points[It->second]-Pos).Norm();
+                        if (D>BestD)continue;
+                        BestD=D;
+                        Best=(int)It->second;
+                    }
+                }
+        return Best;
+    }
+
+    PositionHash():CellSize(1){}
+};
+
+#endif
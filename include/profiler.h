@@ -0,0 +1,195 @@
+#ifndef PARAFASHION_PROFILER
+#define PARAFASHION_PROFILER
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+//peak resident memory of the process in bytes, 0 if not available
+inline size_t PeakMemoryBytes()
+{
+#if defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage)!=0)return 0;
+    return (size_t)usage.ru_maxrss;
+#elif defined(__unix__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage)!=0)return 0;
+    return (size_t)usage.ru_maxrss*1024;
+#else
+    return 0;
+#endif
+}
+
+//collect per named scope the number of calls, the wall time and the CPU time
+//of the process (all threads) spent inside it, plus the largest growth of the
+//peak memory of the process while it was open (the peak itself is only known
+//for the whole process, a nested or concurrent scope counts in all the open
+//ones); scopes may be opened concurrently by several threads
+class Profiler
+{
+public:
+
+    struct ScopeStats
+    {
+        size_t Calls;
+        double Wall;
+        double MaxWall;
+        double CPU;
+        size_t PeakGrowth;
+
+        ScopeStats():Calls(0),Wall(0),MaxWall(0),CPU(0),PeakGrowth(0){}
+    };
+
+private:
+
+    std::map<std::string,ScopeStats> Scopes;
+    std::mutex Lock;
+
+public:
+
+    bool Enabled;
+
+    static Profiler &Get()
+    {
+        static Profiler P;
+        return P;
+    }
+
+    void Add(const std::string &Name,double Wall,double CPU,size_t Growth)
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        ScopeStats &S=Scopes[Name];
+        S.Calls++;
+        S.Wall+=Wall;
+        S.MaxWall=std::max(S.MaxWall,Wall);
+        S.CPU+=CPU;
+        S.PeakGrowth=std::max(S.PeakGrowth,Growth);
+    }
+
+    ScopeStats Stats(const std::string &Name)
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        if (Scopes.count(Name)==0)return ScopeStats();
+        return Scopes[Name];
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Scopes.clear();
+    }
+
+    nlohmann::json Report()
+    {
+        nlohmann::json Rep;
+        Rep["peak_memory_bytes"]=PeakMemoryBytes();
+        std::lock_guard<std::mutex> guard(Lock);
+        nlohmann::json &RepScopes=Rep["scopes"];
+        RepScopes=nlohmann::json::object();
+        std::map<std::string,ScopeStats>::const_iterator IteS;
+        for (IteS=Scopes.begin();IteS!=Scopes.end();IteS++)
+        {
+            const ScopeStats &S=(*IteS).second;
+            nlohmann::json &Curr=RepScopes[(*IteS).first];
+            Curr["calls"]=S.Calls;
+            Curr["wall_s"]=S.Wall;
+            Curr["max_wall_s"]=S.MaxWall;
+            Curr["cpu_s"]=S.CPU;
+            Curr["peak_growth_bytes"]=S.PeakGrowth;
+        }
+        return Rep;
+    }
+
+    bool SaveReport(const std::string &path)
+    {
+        FILE *f=fopen(path.c_str(),"wt");
+        if (f==NULL)return false;
+        std::string Text=Report().dump(2);
+        fprintf(f,"%s\n",Text.c_str());
+        fclose(f);
+        return true;
+    }
+
+    void PrintReport()
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        std::map<std::string,ScopeStats>::const_iterator IteS;
+        for (IteS=Scopes.begin();IteS!=Scopes.end();IteS++)
+        {
+            const ScopeStats &S=(*IteS).second;
+            std::cout<<(*IteS).first<<": "<<S.Calls<<" calls, ";
+            std::cout<<S.Wall<<" s wall, "<<S.CPU<<" s cpu, ";
+            std::cout<<S.PeakGrowth/(1024*1024)<<" MB peak growth"<<std::endl;
+        }
+    }
+
+    Profiler():Enabled(true){}
+};
+
+//measure from construction to Stop() or to the end of the enclosing block;
+//with the profiler disabled only the wall time returned by Stop() is taken,
+//the CPU time and the peak memory (one syscall each) are skipped
+class ProfileScope
+{
+    std::string Name;
+    std::chrono::steady_clock::time_point StartWall;
+    std::clock_t StartCPU;
+    size_t StartPeak;
+    bool Running;
+    bool Recording;
+
+public:
+
+    //seconds elapsed so far
+    double Elapsed()const
+    {
+        std::chrono::duration<double> Wall=std::chrono::steady_clock::now()-StartWall;
+        return Wall.count();
+    }
+
+    double Stop()
+    {
+        if (!Running)return 0;
+        Running=false;
+        double Wall=Elapsed();
+        if (!Recording)return Wall;
+        double CPU=(double)(std::clock()-StartCPU)/CLOCKS_PER_SEC;
+        size_t EndPeak=PeakMemoryBytes();
+        size_t Growth=(EndPeak>StartPeak)?(EndPeak-StartPeak):0;
+        Profiler::Get().Add(Name,Wall,CPU,Growth);
+        return Wall;
+    }
+
+    ProfileScope(const std::string &_Name):Name(_Name)
+    {
+        Recording=Profiler::Get().Enabled;
+        StartCPU=0;
+        StartPeak=0;
+        if (Recording)
+        {
+            StartCPU=std::clock();
+            StartPeak=PeakMemoryBytes();
+        }
+        StartWall=std::chrono::steady_clock::now();
+        Running=true;
+    }
+
+    ~ProfileScope(){Stop();}
+};
+
+#define PARAFASHION_PROFILE_CAT(a,b) a##b
+#define PARAFASHION_PROFILE_NAME(line) PARAFASHION_PROFILE_CAT(ProfScope,line)
+#define PARAFASHION_PROFILE(name) ProfileScope PARAFASHION_PROFILE_NAME(__LINE__)(name)
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef PROJECTION_INDEX
+#define PROJECTION_INDEX
+
+#include <vector>
+#include "mesh_projector.h"
+
+//closest face and barycentric coordinates of a set of points,
+//together with the points themselves so it can be checked for reuse
+template <class CoordType>
+struct ProjectionBasis
+{
+    std::vector<CoordType> Pos;
+    std::vector<size_t> FaceIdx;
+    std::vector<CoordType> Bary;
+
+    void Clear()
+    {
+        Pos.clear();
+        FaceIdx.clear();
+        Bary.clear();
+    }
+};
+
+//projection engine over the faces of a mesh that is kept across queries,
+//it is rebuilt only when the faces are reallocated or the vertices moved
+template <class TriMeshType>
+class ProjectionIndex
+{
+    typedef typename TriMeshType::FaceType FaceType;
+    typedef typename TriMeshType::CoordType CoordType;
+    typedef typename TriMeshType::ScalarType ScalarType;
+
+    MeshProjector<TriMeshType> Projector;
+    TriMeshType *Mesh;
+    const FaceType *FaceBase;
+    size_t NumF;
+    std::vector<CoordType> Pos;
+    bool Valid;
+
+public:
+
+    static bool SamePositions(const TriMeshType &mesh,
+                              const std::vector<CoordType> &Pos)
+    {
+        if (Pos.size()!=mesh.vert.size())return false;
+        for (size_t i=0;i<mesh.vert.size();i++)
+            if (mesh.vert[i].cP()!=Pos[i])return false;
+        return true;
+    }
+
+    bool IsValidFor(const TriMeshType &mesh)const
+    {
+        if (!Valid)return false;
+        if (Mesh!=&mesh)return false;
+        if (NumF!=mesh.face.size())return false;
+        if ((NumF>0)&&(FaceBase!=&mesh.face[0]))return false;
+        return SamePositions(mesh,Pos);
+    }
+
+    void Invalidate(){Valid=false;}
+
+    //returns true if the index had to be rebuilt
+    bool Update(TriMeshType &mesh)
+    {
+        if (IsValidFor(mesh))return false;
+        Projector.Build(mesh);
+        Mesh=&mesh;
+        NumF=mesh.face.size();
+        FaceBase=(NumF>0)?&mesh.face[0]:NULL;
+        Pos.resize(mesh.vert.size());
+        for (size_t i=0;i<mesh.vert.size();i++)
+            Pos[i]=mesh.vert[i].cP();
+        Valid=true;
+        return true;
+    }
+
+    //closest face to P, with the barycentric coordinates of the closest point
+    FaceType *Closest(const CoordType &P,CoordType &Bary)
+    {
+        assert(Valid);
+        if (NumF==0)return NULL;
+        ScalarType SqDist;
+        return &Mesh->face[Projector.Closest(P,Bary,SqDist)];
+    }
+
+    void Project(const std::vector<CoordType> &Points,
+                 ProjectionBasis<CoordType> &Basis)
+    {
+        assert(Valid);
+        assert(NumF>0);
+        ProjectionBatch<ScalarType> Batch;
+        Projector.Project(Points,Batch);
+        Basis.Pos=Points;
+        Basis.FaceIdx.swap(Batch.FaceIdx);
+        Basis.Bary.resize(Points.size());
+        for (size_t i=0;i<Points.size();i++)
+            Basis.Bary[i]=Batch.template Bary<CoordType>(i);
+    }
+
+    ProjectionIndex():Mesh(NULL),FaceBase(NULL),NumF(0),Valid(false){}
+};
+
+#endif
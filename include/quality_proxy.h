@@ -0,0 +1,280 @@
+#ifndef QUALITY_PROXY
+#define QUALITY_PROXY
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/local_optimization.h>
+#include <vcg/complex/algorithms/local_optimization/tri_edge_collapse.h>
+#include <vcg/complex/algorithms/clean.h>
+#include <vcg/space/index/grid_static_ptr.h>
+#include <vcg/complex/algorithms/closest.h>
+
+//a coarse version of the mesh used to trace, computed once, with the map from
+//each face of the original mesh to the proxy face covering it; candidate patches
+//are transferred on the proxy so their quality can be estimated at low resolution
+template <class MeshType>
+class QualityProxy
+{
+    typedef typename MeshType::CoordType CoordType;
+    typedef typename MeshType::ScalarType ScalarType;
+    typedef typename MeshType::FaceType FaceType;
+    typedef typename MeshType::VertexType VertexType;
+    typedef typename vcg::tri::BasicVertexPair<VertexType> VertPair;
+
+    //shortest edge first; V(0) is removed and merged on V(1), a border vertex
+    //only along a border edge and only if it is not a corner of the outline
+    class ProxyEdgeCollapse: public vcg::tri::TriEdgeCollapse<MeshType,VertPair,ProxyEdgeCollapse>
+    {
+        //vertices connected to V by an edge of a single face,
+        //from the vertex-face adjacency that the collapses keep updated
+        static void BorderNeighbours(VertexType *V,std::vector<VertexType*> &Neigh)
+        {
+            std::map<VertexType*,size_t> EdgeCount;
+            vcg::face::VFIterator<FaceType> VFI(V);
+            for (;!VFI.End();++VFI)
+            {
+                EdgeCount[VFI.F()->V1(VFI.I())]++;
+                EdgeCount[VFI.F()->V2(VFI.I())]++;
+            }
+            Neigh.clear();
+            typename std::map<VertexType*,size_t>::const_iterator IteV;
+            for (IteV=EdgeCount.begin();IteV!=EdgeCount.end();IteV++)
+                if ((*IteV).second==1)Neigh.push_back((*IteV).first);
+        }
+
+    public:
+        inline ProxyEdgeCollapse(const VertPair &p, int mark, vcg::BaseParameterClass *pp)
+        {
+            this->localMark = mark;
+            this->pos=p;
+            this->_priority = this->ComputePriority(pp);
+        }
+
+        bool IsFeasible(vcg::BaseParameterClass *pp)
+        {
+            VertexType *V0=this->pos.V(0);
+            VertexType *V1=this->pos.V(1);
+            if (V0->IsB())
+            {
+                std::vector<VertexType*> Neigh;
+                BorderNeighbours(V0,Neigh);
+                if (Neigh.size()!=2)return false;
+                if ((Neigh[0]!=V1)&&(Neigh[1]!=V1))return false;
+                VertexType *Other=(Neigh[0]==V1)?Neigh[1]:Neigh[0];
+
+                //the outline must go almost straight through V0 (within ~10 degrees)
+                CoordType Dir0=V0->cP()-Other->cP();
+                CoordType Dir1=V1->cP()-V0->cP();
+                if ((Dir0.Norm()==0)||(Dir1.Norm()==0))return false;
+                Dir0.Normalize();
+                Dir1.Normalize();
+                if ((Dir0*Dir1)<0.985)return false;
+            }
+            return vcg::tri::TriEdgeCollapse<MeshType,VertPair,ProxyEdgeCollapse>::IsFeasible(pp);
+        }
+    };
+
+    MeshType Proxy;
+    std::vector<size_t> FineToProxy;
+    std::vector<ScalarType> ProxyFineArea;
+    //length distortion introduced by the decimation around each proxy face
+    std::vector<ScalarType> ProxyError;
+    std::map<CoordType,size_t> FineFaceIndex;
+
+    //how many candidates were decided on the proxy and how many needed the full mesh
+    mutable std::atomic<size_t> NumAccepted,NumRejected,NumBorderline;
+
+    //true if m has two vertices in the same place, i.e. it is cut open
+    //along a dart or a self glued seam inside its faces
+    static bool HasCuts(const MeshType &m)
+    {
+        std::vector<CoordType> Pos;
+        for (size_t i=0;i<m.vert.size();i++)
+            if (!m.vert[i].IsD())Pos.push_back(m.vert[i].cP());
+        std::sort(Pos.begin(),Pos.end());
+        return (std::adjacent_find(Pos.begin(),Pos.end())!=Pos.end());
+    }
+
+    //a single manifold component with Euler characteristic one
+    static bool IsDisc(MeshType &m)
+    {
+        vcg::tri::UpdateTopology<MeshType>::FaceFace(m);
+        if (vcg::tri::Clean<MeshType>::CountNonManifoldEdgeFF(m)>0)return false;
+        if (vcg::tri::Clean<MeshType>::CountNonManifoldVertexFF(m,false)>0)return false;
+        std::vector<std::pair<int,typename MeshType::FacePointer> > CCV;
+        if (vcg::tri::Clean<MeshType>::ConnectedComponents(m,CCV)!=1)return false;
+        int NumE,NumBorderE,NumNonManifE;
+        vcg::tri::Clean<MeshType>::CountEdgeNum(m,NumE,NumBorderE,NumNonManifE);
+        return ((m.vn-NumE+m.fn)==1);
+    }
+
+    static CoordType FaceKey(const FaceType &f)
+    {
+        CoordType P[3]={f.cP(0),f.cP(1),f.cP(2)};
+        std::sort(P,P+3);
+        return ((P[0]+P[1]+P[2])/3);
+    }
+
+public:
+
+    void Clear()
+    {
+        Proxy.Clear();
+        FineToProxy.clear();
+        ProxyFineArea.clear();
+        ProxyError.clear();
+        FineFaceIndex.clear();
+        NumAccepted=0;
+        NumRejected=0;
+        NumBorderline=0;
+    }
+
+    void CountAccepted()const{NumAccepted++;}
+    void CountRejected()const{NumRejected++;}
+    void CountBorderline()const{NumBorderline++;}
+
+    void PrintStats()const
+    {
+        std::cout<<"Quality proxy: "<<NumAccepted.load()<<" accepted, ";
+        std::cout<<NumRejected.load()<<" rejected, ";
+        std::cout<<NumBorderline.load()<<" checked at full resolution"<<std::endl;
+    }
+
+    bool IsInitialized()const{return (Proxy.face.size()>0);}
+
+    size_t ProxyFaces()const{return Proxy.face.size();}
+
+    //reduction is the ratio between the vertices of the fine and of the proxy mesh
+    void Init(const MeshType &fine,ScalarType reduction=4)
+    {
+        Clear();
+
+        for (size_t i=0;i<fine.face.size();i++)
+            FineFaceIndex[FaceKey(fine.face[i])]=i;
+
+        vcg::tri::Append<MeshType,MeshType>::MeshCopyConst(Proxy,fine);
+        Proxy.UpdateAttributes();
+        vcg::tri::UpdateTopology<MeshType>::VertexFace(Proxy);
+        vcg::tri::UpdateFlags<MeshType>::VertexBorderFromFaceAdj(Proxy);
+
+        vcg::BaseParameterClass BClass;
+        vcg::LocalOptimization<MeshType> DeciSession(Proxy,&BClass);
+        DeciSession.template Init<ProxyEdgeCollapse>();
+        size_t targetV=std::max((size_t)3,(size_t)(Proxy.vert.size()/reduction));
+        while(DeciSession.DoOptimization() && (size_t)Proxy.vn>targetV){};
+
+        vcg::tri::Clean<MeshType>::RemoveUnreferencedVertex(Proxy);
+        vcg::tri::Allocator<MeshType>::CompactEveryVector(Proxy);
+        Proxy.UpdateAttributes();
+
+        //then map every fine face to the closest proxy face
+        vcg::GridStaticPtr<FaceType,ScalarType> ProxyGrid;
+        ProxyGrid.Set(Proxy.face.begin(),Proxy.face.end());
+        ScalarType MaxD=Proxy.bbox.Diag();
+        ProxyFineArea.resize(Proxy.face.size(),0);
+        for (size_t i=0;i<fine.face.size();i++)
+        {
+            CoordType Bary=(fine.face[i].cP(0)+fine.face[i].cP(1)+fine.face[i].cP(2))/3;
+            ScalarType MinD;
+            CoordType closestPt;
+            FaceType *f=vcg::tri::GetClosestFaceBase(Proxy,ProxyGrid,Bary,MaxD,MinD,closestPt);
+            assert(f!=NULL);
+            size_t IndexF=vcg::tri::Index(Proxy,f);
+            FineToProxy.push_back(IndexF);
+            ProxyFineArea[IndexF]+=vcg::DoubleArea(fine.face[i]);
+        }
+
+        //the decimation smooths the surface out, so the fine faces mapped on a
+        //proxy face cover more area than the face itself: the square root of
+        //the ratio is the length the proxy misses, measured on the face and on
+        //its neighbours since the closest face mapping is noisy on single faces
+        ProxyError.resize(Proxy.face.size(),0);
+        ScalarType MaxError=0;
+        for (size_t i=0;i<Proxy.face.size();i++)
+        {
+            ScalarType FineA=ProxyFineArea[i];
+            ScalarType ProxyA=vcg::DoubleArea(Proxy.face[i]);
+            for (size_t j=0;j<3;j++)
+            {
+                if (vcg::face::IsBorder(Proxy.face[i],j))continue;
+                size_t IndexF=vcg::tri::Index(Proxy,Proxy.face[i].cFFp(j));
+                FineA+=ProxyFineArea[IndexF];
+                ProxyA+=vcg::DoubleArea(Proxy.face[IndexF]);
+            }
+            if (ProxyA>0)
+                ProxyError[i]=std::fabs(std::sqrt(FineA/ProxyA)-1);
+            else
+                ProxyError[i]=1;
+            MaxError=std::max(MaxError,ProxyError[i]);
+        }
+        std::cout<<"Quality proxy: "<<fine.face.size()<<" -> "<<Proxy.face.size()<<" faces, ";
+        std::cout<<"max length error "<<MaxError<<std::endl;
+    }
+
+    //build the proxy patch made of the proxy faces mostly covered by the faces of m,
+    //with the largest length error of those faces;
+    //returns false if m is not made of faces of the fine mesh, if nothing is left
+    //or if the proxy patch would not have the same topology of m: the proxy
+    //shares its vertices everywhere, so the cuts of m (darts, self glued seams)
+    //are not reproduced and the selection of the covered faces can leave
+    //holes or several pieces; those candidates are checked at full resolution
+    bool GetProxyPatch(const MeshType &m,MeshType &ProxyPatch,ScalarType &Error)const
+    {
+        if (!IsInitialized())return false;
+        if (HasCuts(m))return false;
+
+        std::map<size_t,ScalarType> CoveredArea;
+        for (size_t i=0;i<m.face.size();i++)
+        {
+            if (m.face[i].IsD())continue;
+            typename std::map<CoordType,size_t>::const_iterator IteF=FineFaceIndex.find(FaceKey(m.face[i]));
+            if (IteF==FineFaceIndex.end())return false;
+            CoveredArea[FineToProxy[(*IteF).second]]+=vcg::DoubleArea(m.face[i]);
+        }
+
+        std::vector<size_t> ProxyF;
+        typename std::map<size_t,ScalarType>::const_iterator IteA;
+        for (IteA=CoveredArea.begin();IteA!=CoveredArea.end();IteA++)
+            if ((*IteA).second>=ProxyFineArea[(*IteA).first]*0.5)
+                ProxyF.push_back((*IteA).first);
+        if (ProxyF.size()==0)return false;
+
+        Error=0;
+        for (size_t i=0;i<ProxyF.size();i++)
+            Error=std::max(Error,ProxyError[ProxyF[i]]);
+
+        //copy the faces sharing the vertices, the proxy is never modified
+        //so this can be called concurrently
+        ProxyPatch.Clear();
+        std::map<size_t,size_t> VertMap;
+        for (size_t i=0;i<ProxyF.size();i++)
+            for (size_t j=0;j<3;j++)
+            {
+                size_t IndexV=vcg::tri::Index(Proxy,Proxy.face[ProxyF[i]].cV(j));
+                if (VertMap.count(IndexV)>0)continue;
+                size_t NewIndex=VertMap.size();
+                VertMap[IndexV]=NewIndex;
+            }
+        vcg::tri::Allocator<MeshType>::AddVertices(ProxyPatch,VertMap.size());
+        std::map<size_t,size_t>::const_iterator IteV;
+        for (IteV=VertMap.begin();IteV!=VertMap.end();IteV++)
+            ProxyPatch.vert[(*IteV).second].P()=Proxy.vert[(*IteV).first].cP();
+        vcg::tri::Allocator<MeshType>::AddFaces(ProxyPatch,ProxyF.size());
+        for (size_t i=0;i<ProxyF.size();i++)
+            for (size_t j=0;j<3;j++)
+            {
+                size_t IndexV=vcg::tri::Index(Proxy,Proxy.face[ProxyF[i]].cV(j));
+                ProxyPatch.face[i].V(j)=&ProxyPatch.vert[VertMap[IndexV]];
+            }
+        ProxyPatch.UpdateAttributes();
+        return IsDisc(ProxyPatch);
+    }
+
+    QualityProxy():NumAccepted(0),NumRejected(0),NumBorderline(0){}
+};
+
+#endif
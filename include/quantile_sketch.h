@@ -0,0 +1,129 @@
+#ifndef QUANTILE_SKETCH
+#define QUANTILE_SKETCH
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+
+//streaming quantile estimation with bounded memory: values are counted in
+//logarithmic bins, so any quantile is returned with a relative error below
+//RelativeError whatever the number of values; sketches filled by different
+//threads can be merged
+template <class ScalarType>
+class QuantileSketch
+{
+    //counts of the bins in [Offset,Offset+Bins.size())
+    struct BinStore
+    {
+        int Offset;
+        std::vector<size_t> Bins;
+
+        void Add(int Key,size_t Num)
+        {
+            if (Bins.empty())
+            {
+                Offset=Key;
+                Bins.push_back(0);
+            }
+            if (Key<Offset)
+            {
+                Bins.insert(Bins.begin(),Offset-Key,0);
+                Offset=Key;
+            }
+            if (Key>=Offset+(int)Bins.size())
+                Bins.resize(Key-Offset+1,0);
+            Bins[Key-Offset]+=Num;
+        }
+
+        void Merge(const BinStore &Other)
+        {
+            for (size_t i=0;i<Other.Bins.size();i++)
+                if (Other.Bins[i]>0)
+                    Add(Other.Offset+(int)i,Other.Bins[i]);
+        }
+
+        BinStore():Offset(0){}
+    };
+
+    double Gamma;
+    double LogGamma;
+    //positive values, absolute value of the negative ones
+    BinStore Pos,Neg;
+    size_t Zeros;
+    size_t Count;
+
+    int Key(double Val)const
+    {
+        return (int)std::ceil(std::log(Val)/LogGamma);
+    }
+
+    //value in the middle of the bin (relative error wise)
+    double BinValue(int Key)const
+    {
+        return 2*std::pow(Gamma,(double)Key)/(Gamma+1);
+    }
+
+public:
+
+    //absolute values below it are counted as zero
+    static double MinValue(){return 1e-12;}
+
+    void Add(ScalarType Val)
+    {
+        Count++;
+        double AbsVal=std::fabs((double)Val);
+        if (AbsVal<MinValue())
+            Zeros++;
+        else if (Val>0)
+            Pos.Add(Key(AbsVal),1);
+        else
+            Neg.Add(Key(AbsVal),1);
+    }
+
+    void Merge(const QuantileSketch &Other)
+    {
+        assert(Other.Gamma==Gamma);
+        Pos.Merge(Other.Pos);
+        Neg.Merge(Other.Neg);
+        Zeros+=Other.Zeros;
+        Count+=Other.Count;
+    }
+
+    size_t Size()const{return Count;}
+
+    //the value that would be at index Count*Q once all the values are sorted
+    ScalarType Quantile(double Q)const
+    {
+        if (Count==0)return 0;
+        size_t Rank=(size_t)(Count*Q);
+        Rank=std::min(Rank,Count-1);
+
+        //negative values first, from the largest in absolute value
+        size_t Seen=0;
+        for (int i=(int)Neg.Bins.size()-1;i>=0;i--)
+        {
+            Seen+=Neg.Bins[i];
+            if (Seen>Rank)return (ScalarType)(-BinValue(Neg.Offset+i));
+        }
+        Seen+=Zeros;
+        if (Seen>Rank)return 0;
+        for (size_t i=0;i<Pos.Bins.size();i++)
+        {
+            Seen+=Pos.Bins[i];
+            if (Seen>Rank)return (ScalarType)BinValue(Pos.Offset+(int)i);
+        }
+        return (ScalarType)BinValue(Pos.Offset+(int)Pos.Bins.size()-1);
+    }
+
+    QuantileSketch(double RelativeError=0.005)
+    {
+        Gamma=(1+RelativeError)/(1-RelativeError);
+        LogGamma=std::log(Gamma);
+        Zeros=0;
+        Count=0;
+    }
+};
+
+#endif
@@ -2,7 +2,10 @@
 #define SVG_EXPORTER
 
 #include <vcg/complex/complex.h>
+#ifndef PARAFASHION_HEADLESS
 #include <wrap/qt/Outline2ToQImage.h>
+#endif
+#include <vcg/math/similarity2.h>
 #include <vcg/simplex/face/pos.h>
 #include <set>
 #include <vcg/complex/algorithms/parametrization/uv_utils.h>
@@ -10,10 +13,13 @@
 #include <clipper.hpp>
 #include <vcg/complex/algorithms/point_sampling.h>
 #include <wrap/io_trimesh/export.h>
+#include "profiler.h"
 //#include "./lib/CavalierContours/include/cavc/polylineoffset.hpp"
 //#include <vcg/complex/algorithms/update/flag.h>
+#ifndef PARAFASHION_HEADLESS
 #include <QSvgRenderer>
 #include <QIcon>
+#endif
 
 template <class TriMeshType>
 class SvgExporter
@@ -23,6 +29,77 @@ class SvgExporter
     typedef typename TriMeshType::CoordType CoordType;
     typedef typename TriMeshType::ScalarType ScalarType;
 
+    //walk along the selected edges as vcg::face::Pos::NextEdgeS does, on flat
+    //per face arrays: vertex indices, adjacent face and edge, selected edges
+    struct OutlineWalker
+    {
+        std::vector<size_t> FV;
+        std::vector<size_t> FFf;
+        std::vector<unsigned char> FFe;
+        std::vector<bool> Sel;
+
+        size_t F,Z,V;
+
+        static size_t Next(size_t z){return (z+1)%3;}
+        static size_t Prev(size_t z){return (z+2)%3;}
+
+        void FlipV()
+        {
+            if (FV[F*3+Next(Z)]==V)V=FV[F*3+Z];
+            else V=FV[F*3+Next(Z)];
+        }
+
+        void FlipE()
+        {
+            if (FV[F*3+Next(Z)]==V)Z=Next(Z);
+            else Z=Prev(Z);
+        }
+
+        void FlipF()
+        {
+            size_t NewF=FFf[F*3+Z];
+            Z=FFe[F*3+Z];
+            F=NewF;
+        }
+
+        void NextEdgeS()
+        {
+            FlipV();
+            do{
+                FlipE();
+                FlipF();
+            }while (!Sel[F*3+Z]);
+        }
+
+        void Init(TriMeshType &mesh)
+        {
+            size_t NumF=mesh.face.size();
+            FV.resize(NumF*3);
+            FFf.resize(NumF*3);
+            FFe.resize(NumF*3);
+            Sel.assign(NumF*3,false);
+            for (size_t i=0;i<NumF;i++)
+                for (size_t j=0;j<3;j++)
+                {
+                    FV[i*3+j]=vcg::tri::Index(mesh,mesh.face[i].V(j));
+                    FFf[i*3+j]=vcg::tri::Index(mesh,mesh.face[i].FFp(j));
+                    FFe[i*3+j]=mesh.face[i].FFi(j);
+                    Sel[i*3+j]=mesh.face[i].IsFaceEdgeS(j);
+                }
+        }
+    };
+
+public:
+
+    //print the outline extraction details
+    static bool &Verbose()
+    {
+        static bool Verb=false;
+        return Verb;
+    }
+
+private:
+
     static void GetOutLines(TriMeshType &mesh,
                             std::vector< std::vector<vcg::Point2f> > &outline2Vec,
                             std::vector< std::vector<CoordType> > &outline3Vec,
@@ -47,39 +124,60 @@ class SvgExporter
         }
         //vcg::tri::io::ExporterPLY<TriMeshType>::Save(mesh,"test.ply");
 
-        outline2Vec.clear();
-        std::set<std::pair<size_t,size_t> > FaceEdge;
+        OutlineWalker Walker;
+        Walker.Init(mesh);
+
+        //every selected edge is visited once, so the points of all the
+        //polylines fit in buffers as large as the number of selected edges
+        size_t NumSel=0;
+        for (size_t i=0;i<Walker.Sel.size();i++)
+            if (Walker.Sel[i])NumSel++;
+        std::vector<vcg::Point2f> Points2;
+        std::vector<CoordType> Points3;
+        std::vector<size_t> Start;
+        Points2.reserve(NumSel);
+        Points3.reserve(NumSel);
+        std::vector<bool> Visited(Walker.Sel.size(),false);
 
         for (size_t i=0;i<mesh.face.size();i++)
         {
             //if (mesh.face[i].IsS())continue;
             for (size_t j=0;j<3;j++)
             {
-                if (!mesh.face[i].IsFaceEdgeS(j))continue;
-                if (FaceEdge.count(std::pair<size_t,size_t> (i,j))>0)continue;
-                outline2Vec.resize(outline2Vec.size()+1);
-                outline3Vec.resize(outline3Vec.size()+1);
-                vcg::face::Pos<FaceType> PosF(&mesh.face[i],j);
-                vcg::face::Pos<FaceType> PosInit=PosF;
-                std::cout<<"Starting new polyline"<<std::endl;
+                if (!Walker.Sel[i*3+j])continue;
+                if (Visited[i*3+j])continue;
+                Start.push_back(Points2.size());
+                Walker.F=i;
+                Walker.Z=j;
+                Walker.V=Walker.FV[i*3+j];
                 do{
-                    size_t IndexF=vcg::tri::Index(mesh,PosF.F());
-                    size_t IndexE=PosF.E();
-                    std::cout<<"IndexF"<<IndexF<<std::endl;
-                    std::cout<<"IndexE"<<IndexE<<std::endl;
-                    std::pair<size_t,size_t> Key(IndexF,IndexE);
-                    assert(FaceEdge.count(Key)==0);
-                    FaceEdge.insert(std::pair<size_t,size_t>(IndexF,IndexE));
+                    size_t Key=Walker.F*3+Walker.Z;
+                    //should not happen on a coherent selection
+                    if (Visited[Key])break;
+                    Visited[Key]=true;
                     vcg::Point2f UV;
-                    UV.Import(PosF.F()->WT(PosF.E()).P()*scaleVal);
-                    outline2Vec.back().push_back(UV);
-                    outline3Vec.back().push_back(PosF.V()->P());
-                    std::cout<<"Step"<<std::endl;
-                    PosF.NextEdgeS();
-                }while (PosF!=PosInit);
+                    UV.Import(mesh.face[Walker.F].WT(Walker.Z).P()*scaleVal);
+                    Points2.push_back(UV);
+                    Points3.push_back(mesh.vert[Walker.V].P());
+                    Walker.NextEdgeS();
+                }while ((Walker.F!=i)||(Walker.Z!=j)||(Walker.V!=Walker.FV[i*3+j]));
+                if (Verbose())
+                    std::cout<<"Polyline of "<<Points2.size()-Start.back()<<" edges"<<std::endl;
             }
         }
-        std::cout<<"Number Polylines:"<<outline2Vec.size()<<std::endl;
+
+        outline2Vec.clear();
+        outline3Vec.clear();
+        outline2Vec.resize(Start.size());
+        outline3Vec.resize(Start.size());
+        for (size_t i=0;i<Start.size();i++)
+        {
+            size_t End=(i+1<Start.size())?Start[i+1]:Points2.size();
+            outline2Vec[i].assign(Points2.begin()+Start[i],Points2.begin()+End);
+            outline3Vec[i].assign(Points3.begin()+Start[i],Points3.begin()+End);
+        }
+        if (Verbose())
+            std::cout<<"Number Polylines:"<<outline2Vec.size()<<std::endl;
     }
 
     //    static vcg::Box2<ScalarType> GetBox(TriMeshType &mesh,
@@ -224,32 +322,18 @@ class SvgExporter
         }
     }
 
-public:
-
-    static void ExportUVPolyline(TriMeshType &mesh,
-                                 const char *pathSVG,
-                                 const char *pathPNG,
-                                 QImage &SVGTxt,
-                                 float scaleVal=1000,
-                                 float penwidth=2,
-                                 float boundSize=15,
-                                 float fontsize=7)
+    static void GetLayout(TriMeshType &mesh,
+                          float scaleVal,
+                          float boundSize,
+                          float fontsize,
+                          std::vector< std::vector<vcg::Point2f> > &outline2Vec,
+                          std::vector<std::vector<std::string> > &Label,
+                          std::vector<std::vector<float> > &LabelRad,
+                          std::vector<std::vector<vcg::Similarity2f> > &trText)
     {
-        //vcg::Box2<ScalarType> uv_box=vcg::tri::UV_Utils<CMesh>::PerWedgeUVBox(mesh);
-
-        std::vector< std::vector<vcg::Point2f> > outline2Vec;
         std::vector< std::vector<CoordType> > outline3Vec;
         GetOutLines(mesh,outline2Vec,outline3Vec,scaleVal);
 
-
-        Outline2Dumper::Param pp;
-        pp.penWidth=penwidth;
-        pp.fontSize=fontsize;
-
-        std::vector<std::vector<std::string> > Label;
-        std::vector<std::vector<float> > LabelRad;
-        std::vector<std::vector<vcg::Similarity2f> > trText;
-
         trText.resize(outline2Vec.size());
         LabelRad.resize(outline2Vec.size());
         Label.resize(outline2Vec.size());
@@ -277,7 +361,6 @@ public:
                 }
         }
 
-
         //create the Offset
         if (boundSize!=0)
         {
@@ -286,11 +369,124 @@ public:
             outline2Vec.insert(outline2Vec.end(),OffSetted.begin(),OffSetted.end());
         }
 
-        std::vector<vcg::Similarity2f> trVec;
-        trVec.resize(outline2Vec.size());
         trText.resize(outline2Vec.size());
         LabelRad.resize(outline2Vec.size());
         Label.resize(outline2Vec.size());
+    }
+
+    static std::string EscapeXML(const std::string &Text)
+    {
+        std::string Escaped;
+        for (size_t i=0;i<Text.size();i++)
+        {
+            if (Text[i]=='&')Escaped+="&amp;";
+            else if (Text[i]=='<')Escaped+="&lt;";
+            else if (Text[i]=='>')Escaped+="&gt;";
+            else if (Text[i]=='"')Escaped+="&quot;";
+            else if (Text[i]=='\'')Escaped+="&apos;";
+            else Escaped+=Text[i];
+        }
+        return Escaped;
+    }
+
+    //plain text writer, does not need any Qt painting device; labels are
+    //placed as Outline2Dumper does: moved to trText.tra, rotated by -trText.rotRad
+    //and centered in a box of half size LabelRad, which also bounds the font
+    static bool WriteOutlineSVG(const char *pathSVG,
+                                const std::vector< std::vector<vcg::Point2f> > &outline2Vec,
+                                const std::vector<std::vector<std::string> > &Label,
+                                const std::vector<std::vector<float> > &LabelRad,
+                                const std::vector<std::vector<vcg::Similarity2f> > &trText,
+                                float penwidth,
+                                float fontsize)
+    {
+        vcg::Box2<ScalarType> UVBBox=GetBox(outline2Vec);
+
+        FILE *F=fopen(pathSVG,"wt");
+        if (F==NULL)return false;
+
+        fprintf(F,"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n");
+        fprintf(F,"<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" ");
+        fprintf(F,"width=\"%f\" height=\"%f\" viewBox=\"%f %f %f %f\">\n",
+                (float)UVBBox.DimX(),(float)UVBBox.DimY(),
+                (float)UVBBox.min.X(),(float)UVBBox.min.Y(),
+                (float)UVBBox.DimX(),(float)UVBBox.DimY());
+
+        for (size_t i=0;i<outline2Vec.size();i++)
+        {
+            if (outline2Vec[i].size()==0)continue;
+            fprintf(F,"<polygon fill=\"none\" stroke=\"black\" stroke-width=\"%f\" points=\"",penwidth);
+            for (size_t j=0;j<outline2Vec[i].size();j++)
+                fprintf(F,"%f,%f ",outline2Vec[i][j].X(),outline2Vec[i][j].Y());
+            fprintf(F,"\"/>\n");
+        }
+
+        for (size_t i=0;i<Label.size();i++)
+            for (size_t j=0;j<Label[i].size();j++)
+            {
+                vcg::Point2f Pos=trText[i][j].tra;
+                float Deg=vcg::math::ToDeg(-trText[i][j].rotRad);
+                float Size=fontsize;
+                if ((i<LabelRad.size())&&(j<LabelRad[i].size())&&(LabelRad[i][j]>0))
+                    Size=std::min(Size,LabelRad[i][j]);
+                fprintf(F,"<text x=\"0\" y=\"0\" transform=\"translate(%f %f) rotate(%f)\" ",
+                        Pos.X(),Pos.Y(),Deg);
+                fprintf(F,"font-family=\"Arial\" font-size=\"%f\" ",Size);
+                fprintf(F,"text-anchor=\"middle\" dominant-baseline=\"middle\">%s</text>\n",
+                        EscapeXML(Label[i][j]).c_str());
+            }
+
+        fprintf(F,"</svg>\n");
+        fclose(F);
+        return true;
+    }
+
+public:
+
+    static bool ExportUVPolylineSVG(TriMeshType &mesh,
+                                    const char *pathSVG,
+                                    float scaleVal=1000,
+                                    float penwidth=2,
+                                    float boundSize=15,
+                                    float fontsize=7)
+    {
+        PARAFASHION_PROFILE("svg_export");
+
+        std::vector< std::vector<vcg::Point2f> > outline2Vec;
+        std::vector<std::vector<std::string> > Label;
+        std::vector<std::vector<float> > LabelRad;
+        std::vector<std::vector<vcg::Similarity2f> > trText;
+        GetLayout(mesh,scaleVal,boundSize,fontsize,outline2Vec,Label,LabelRad,trText);
+
+        return WriteOutlineSVG(pathSVG,outline2Vec,Label,LabelRad,trText,penwidth,fontsize);
+    }
+
+#ifndef PARAFASHION_HEADLESS
+    static void ExportUVPolyline(TriMeshType &mesh,
+                                 const char *pathSVG,
+                                 const char *pathPNG,
+                                 QImage &SVGTxt,
+                                 float scaleVal=1000,
+                                 float penwidth=2,
+                                 float boundSize=15,
+                                 float fontsize=7)
+    {
+        PARAFASHION_PROFILE("svg_export");
+
+        //vcg::Box2<ScalarType> uv_box=vcg::tri::UV_Utils<CMesh>::PerWedgeUVBox(mesh);
+
+        std::vector< std::vector<vcg::Point2f> > outline2Vec;
+        std::vector<std::vector<std::string> > Label;
+        std::vector<std::vector<float> > LabelRad;
+        std::vector<std::vector<vcg::Similarity2f> > trText;
+        GetLayout(mesh,scaleVal,boundSize,fontsize,outline2Vec,Label,LabelRad,trText);
+
+        Outline2Dumper::Param pp;
+        pp.penWidth=penwidth;
+        pp.fontSize=fontsize;
+
+        std::vector<vcg::Similarity2f> trVec;
+        trVec.resize(outline2Vec.size());
 
         //get the bounding box
         vcg::Box2<ScalarType> UVBBox=GetBox(outline2Vec);
@@ -328,6 +524,7 @@ public:
         // Save, image format based on file extension
         SVGTxt.save(pathPNG);
     }
+#endif
 };
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef SYMMETRIZER
 #define SYMMETRIZER
 
+#include <map>
 #include <vcg/space/plane3.h>
 #include <vcg/space/fitting3.h>
 #include <vcg/space/point_matching.h>
@@ -9,6 +10,10 @@
 #include <vcg/complex/algorithms/closest.h>
 #include <vcg/complex/algorithms/clean.h>
 #include <tracing/patch_tracer.h>
+#include "mesh_projector.h"
+#include "symmetry_stencil.h"
+#include "position_hash.h"
+#include <Eigen/Dense>
 #include <vcg/complex/algorithms/clean.h>
 
 template <class TriMeshType>
@@ -146,6 +151,214 @@ void SymmetrizeMesh(TriMeshType &mesh,const vcg::Plane3<typename TriMeshType::Sc
     MirrorMesh(mesh,plane);
 }
 
+//same result as SymmetrizeMesh in a single pass: each face is clipped
+//against the positive side of the plane (edges crossing it are split once,
+//the split vertex is shared by the two faces), the kept pieces and their
+//mirror are written in preallocated arrays and the mesh is rebuilt once;
+//the first half of the vertices and faces is the kept side, the second
+//half its mirror, in the same order
+template <class TriMeshType>
+void SymmetrizeMeshFused(TriMeshType &mesh,const vcg::Plane3<typename TriMeshType::ScalarType> &plane)
+{
+    typedef typename TriMeshType::CoordType CoordType;
+    typedef typename TriMeshType::ScalarType ScalarType;
+    typedef typename TriMeshType::VertexType VertexType;
+
+    //as the edge predicate of RefineMesh
+    ScalarType SplitTol=0.0001;
+    //as MirrorMesh
+    ScalarType alpha=0.00001;
+
+    size_t NumV0=mesh.vert.size();
+    std::vector<ScalarType> Dist(NumV0);
+    for (size_t i=0;i<NumV0;i++)
+        Dist[i]=plane.Direction()*mesh.vert[i].cP()-plane.Offset();
+
+    //new index of the kept vertices, then positions of the kept ones
+    size_t Unused=std::numeric_limits<size_t>::max();
+    std::vector<size_t> NewIndex(NumV0,Unused);
+    std::vector<CoordType> HalfPos;
+    HalfPos.reserve(NumV0);
+    std::vector<size_t> HalfFaces;
+    HalfFaces.reserve(mesh.face.size()*3);
+    std::map<std::pair<size_t,size_t>,size_t> SplitVert;
+
+    const VertexType *VertBase=(NumV0>0)?&mesh.vert[0]:NULL;
+    for (size_t i=0;i<mesh.face.size();i++)
+    {
+        if (mesh.face[i].IsD())continue;
+        size_t IndexV[3];
+        for (size_t j=0;j<3;j++)
+            IndexV[j]=mesh.face[i].cV(j)-VertBase;
+
+        //clip against the positive side
+        size_t Poly[4];
+        size_t PolySize=0;
+        for (size_t j=0;j<3;j++)
+        {
+            size_t VCurr=IndexV[j];
+            size_t VNext=IndexV[(j+1)%3];
+            if (Dist[VCurr]>=0)
+            {
+                if (NewIndex[VCurr]==Unused)
+                {
+                    NewIndex[VCurr]=HalfPos.size();
+                    HalfPos.push_back(mesh.vert[VCurr].cP());
+                }
+                Poly[PolySize++]=NewIndex[VCurr];
+            }
+            bool Crossing=((Dist[VCurr]>0)&&(Dist[VNext]<0))||
+                          ((Dist[VCurr]<0)&&(Dist[VNext]>0));
+            if (!Crossing)continue;
+
+            std::pair<size_t,size_t> Key(std::min(VCurr,VNext),std::max(VCurr,VNext));
+            typename std::map<std::pair<size_t,size_t>,size_t>::iterator It=SplitVert.find(Key);
+            if (It!=SplitVert.end())
+            {
+                Poly[PolySize++]=It->second;
+                continue;
+            }
+            ScalarType T=Dist[Key.first]/(Dist[Key.first]-Dist[Key.second]);
+            size_t SplitIndex;
+            if ((T<SplitTol)||(T>(1-SplitTol)))
+            {
+                //too close to an end, use the vertex itself
+                size_t Closest=(T<SplitTol)?Key.first:Key.second;
+                if (NewIndex[Closest]==Unused)
+                {
+                    NewIndex[Closest]=HalfPos.size();
+                    HalfPos.push_back(mesh.vert[Closest].cP());
+                }
+                SplitIndex=NewIndex[Closest];
+            }
+            else
+            {
+                CoordType P0=mesh.vert[Key.first].cP();
+                CoordType P1=mesh.vert[Key.second].cP();
+                SplitIndex=HalfPos.size();
+                HalfPos.push_back(plane.Projection(P0+(P1-P0)*T));
+            }
+            SplitVert[Key]=SplitIndex;
+            Poly[PolySize++]=SplitIndex;
+        }
+        if (PolySize<3)continue;
+
+        //fan triangulation, skipping the pieces collapsed by the snapping
+        for (size_t j=1;j+1<PolySize;j++)
+        {
+            if ((Poly[0]==Poly[j])||(Poly[j]==Poly[j+1])||(Poly[0]==Poly[j+1]))continue;
+            HalfFaces.push_back(Poly[0]);
+            HalfFaces.push_back(Poly[j]);
+            HalfFaces.push_back(Poly[j+1]);
+        }
+    }
+
+    //merge coincident vertices, as the triangle soup rebuilt by DeleteHalfMesh
+    std::vector<size_t> Sorted(HalfPos.size());
+    for (size_t i=0;i<Sorted.size();i++)
+        Sorted[i]=i;
+    std::sort(Sorted.begin(),Sorted.end(),
+              [&](size_t V0,size_t V1){return HalfPos[V0]<HalfPos[V1];});
+    std::vector<size_t> Merged(HalfPos.size());
+    size_t NumV=0;
+    for (size_t i=0;i<Sorted.size();i++)
+    {
+        if ((i>0)&&(HalfPos[Sorted[i]]==HalfPos[Sorted[i-1]]))
+        {
+            Merged[Sorted[i]]=Merged[Sorted[i-1]];
+            continue;
+        }
+        Merged[Sorted[i]]=NumV++;
+    }
+    std::vector<CoordType> MergedPos(NumV);
+    for (size_t i=0;i<HalfPos.size();i++)
+        MergedPos[Merged[i]]=HalfPos[i];
+    for (size_t i=0;i<HalfFaces.size();i++)
+        HalfFaces[i]=Merged[HalfFaces[i]];
+
+    //write the kept half and its mirror
+    size_t NumF=HalfFaces.size()/3;
+    mesh.Clear();
+    vcg::tri::Allocator<TriMeshType>::AddVertices(mesh,NumV*2);
+    vcg::tri::Allocator<TriMeshType>::AddFaces(mesh,NumF*2);
+    for (size_t i=0;i<NumV;i++)
+    {
+        CoordType Pos=MergedPos[i];
+        mesh.vert[i].P()=Pos;
+        CoordType Proj=plane.Projection(Pos);
+        if ((Proj-Pos).Norm()<alpha)
+            mesh.vert[NumV+i].P()=Pos;
+        else
+            mesh.vert[NumV+i].P()=plane.Mirror(Pos);
+    }
+    for (size_t i=0;i<NumF;i++)
+    {
+        for (size_t j=0;j<3;j++)
+            mesh.face[i].V(j)=&mesh.vert[HalfFaces[i*3+j]];
+        //inverted orientation on the other side
+        mesh.face[NumF+i].V(0)=&mesh.vert[NumV+HalfFaces[i*3+1]];
+        mesh.face[NumF+i].V(1)=&mesh.vert[NumV+HalfFaces[i*3+0]];
+        mesh.face[NumF+i].V(2)=&mesh.vert[NumV+HalfFaces[i*3+2]];
+    }
+    mesh.UpdateAttributes();
+}
+
+//mirror face and barycentric coordinates of each vertex of a mesh, kept
+//together with the mesh it was computed on so it can be reused
+template <class CoordType>
+struct SymmetricMap
+{
+    vcg::Plane3<typename CoordType::ScalarType> Plane;
+    std::vector<CoordType> Pos;
+    std::vector<size_t> FaceV;
+    std::vector<size_t> OppFace;
+    std::vector<CoordType> OppBary;
+
+    template <class MeshType>
+    static void GetFaceV(const MeshType &mesh,std::vector<size_t> &FaceV)
+    {
+        FaceV.resize(mesh.face.size()*3);
+        for (size_t i=0;i<mesh.face.size();i++)
+            for (size_t j=0;j<3;j++)
+                FaceV[i*3+j]=vcg::tri::Index(mesh,mesh.face[i].cV(j));
+    }
+
+    template <class MeshType>
+    bool IsValidFor(const MeshType &mesh,
+                    const vcg::Plane3<typename CoordType::ScalarType> &CurrPlane)const
+    {
+        if (Plane.Direction()!=CurrPlane.Direction())return false;
+        if (Plane.Offset()!=CurrPlane.Offset())return false;
+        if (OppFace.size()!=mesh.vert.size())return false;
+        if (FaceV.size()!=mesh.face.size()*3)return false;
+        for (size_t i=0;i<mesh.vert.size();i++)
+            if (mesh.vert[i].cP()!=Pos[i])return false;
+        for (size_t i=0;i<mesh.face.size();i++)
+            for (size_t j=0;j<3;j++)
+                if (FaceV[i*3+j]!=vcg::tri::Index(mesh,mesh.face[i].cV(j)))return false;
+        return true;
+    }
+
+    template <class MeshType>
+    void SetMesh(const MeshType &mesh,
+                 const vcg::Plane3<typename CoordType::ScalarType> &CurrPlane)
+    {
+        Plane=CurrPlane;
+        Pos.resize(mesh.vert.size());
+        for (size_t i=0;i<mesh.vert.size();i++)
+            Pos[i]=mesh.vert[i].cP();
+        GetFaceV(mesh,FaceV);
+    }
+
+    void Clear()
+    {
+        Pos.clear();
+        FaceV.clear();
+        OppFace.clear();
+        OppBary.clear();
+    }
+};
+
 template <class MeshType>
 class SymmetrizeDeformation
 {
@@ -154,27 +367,166 @@ class SymmetrizeDeformation
     typedef typename MeshType::CoordType CoordType;
     typedef typename MeshType::ScalarType ScalarType;
 
+    //mirror of P, then its closest point on the mesh
+    static void MirrorMatch(const MeshProjector<MeshType> &Projector,
+                            const std::vector<CoordType> &Points,
+                            const CoordType &Normal,
+                            const CoordType &Origin,
+                            std::vector<CoordType> &Matched,
+                            std::vector<ScalarType> &SqDist)
+    {
+        std::vector<CoordType> MirrPos(Points.size());
+        for (size_t i=0;i<Points.size();i++)
+            MirrPos[i]=Points[i]-Normal*(((Points[i]-Origin)*Normal)*2);
+        ProjectionBatch<ScalarType> Batch;
+        Projector.Project(MirrPos,Batch);
+        Matched.resize(Points.size());
+        for (size_t i=0;i<Points.size();i++)
+            Matched[i]=Projector.Interpolate(Batch.FaceIdx[i],Batch.template Bary<CoordType>(i));
+        SqDist=Batch.SqDist;
+    }
+
+    //squared distance below which a fraction Q of the matches fall
+    static ScalarType TrimDistance(const std::vector<ScalarType> &SqDist,ScalarType Q)
+    {
+        std::vector<ScalarType> Sorted=SqDist;
+        size_t Index=std::min((size_t)(Sorted.size()*Q),Sorted.size()-1);
+        std::nth_element(Sorted.begin(),Sorted.begin()+Index,Sorted.end());
+        return Sorted[Index];
+    }
+
 public:
 
-    static vcg::Plane3<ScalarType> SymmetryPlane()
+    //the plane x=0, for meshes already aligned
+    static vcg::Plane3<ScalarType> DefaultPlane()
     {
         vcg::Plane3<ScalarType> Pl;
         Pl.Init(CoordType(0,0,0),CoordType(1,0,0));
         return Pl;
     }
 
-    static CoordType SymmetricVect(const CoordType &vect)
+    //symmetry plane of a mesh in any frame: each principal axis through the
+    //centroid is used as starting normal, then refined ICP like by matching
+    //the mirror of the points with the closest point on the mesh (each pair
+    //votes for its bisector plane, the worst matches are trimmed); the plane
+    //whose mirror is closest to the mesh wins
+    static vcg::Plane3<ScalarType> EstimateSymmetryPlane(MeshType &mesh,
+                                                         size_t max_iter=30,
+                                                         size_t max_samples=5000,
+                                                         ScalarType trim=0.8)
     {
-        vcg::Plane3<ScalarType> Pl=SymmetryPlane();
+        if ((mesh.vert.size()==0)||(mesh.face.size()==0))
+            return DefaultPlane();
+
+        std::vector<CoordType> Points;
+        vcg::Box3<ScalarType> Box;
+        size_t Stride=std::max((size_t)1,mesh.vert.size()/max_samples);
+        for (size_t i=0;i<mesh.vert.size();i+=Stride)
+        {
+            Points.push_back(mesh.vert[i].P());
+            Box.Add(mesh.vert[i].P());
+        }
+        if (Box.Diag()==0)return DefaultPlane();
+
+        CoordType Centroid(0,0,0);
+        for (size_t i=0;i<Points.size();i++)
+            Centroid+=Points[i];
+        Centroid/=Points.size();
+
+        Eigen::Matrix3d Cov=Eigen::Matrix3d::Zero();
+        for (size_t i=0;i<Points.size();i++)
+        {
+            Eigen::Vector3d D(Points[i].X()-Centroid.X(),
+                              Points[i].Y()-Centroid.Y(),
+                              Points[i].Z()-Centroid.Z());
+            Cov+=D*D.transpose();
+        }
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> Solver(Cov);
+
+        MeshProjector<MeshType> Projector;
+        Projector.Build(mesh);
+
+        ScalarType BestScore=std::numeric_limits<ScalarType>::max();
+        CoordType BestNormal(1,0,0);
+        CoordType BestOrigin=Centroid;
+        std::vector<CoordType> Matched;
+        std::vector<ScalarType> SqDist;
+        for (size_t k=0;k<3;k++)
+        {
+            Eigen::Vector3d Axis=Solver.eigenvectors().col(k);
+            CoordType Normal(Axis(0),Axis(1),Axis(2));
+            Normal.Normalize();
+            CoordType Origin=Centroid;
+            for (size_t s=0;s<max_iter;s++)
+            {
+                MirrorMatch(Projector,Points,Normal,Origin,Matched,SqDist);
+                ScalarType MaxSqD=TrimDistance(SqDist,trim);
+
+                CoordType SumDir(0,0,0);
+                CoordType SumMid(0,0,0);
+                size_t Num=0;
+                for (size_t i=0;i<Points.size();i++)
+                {
+                    if (SqDist[i]>MaxSqD)continue;
+                    CoordType Dir=Points[i]-Matched[i];
+                    if ((Dir*Normal)<0)Dir=-Dir;
+                    SumDir+=Dir;
+                    SumMid+=(Points[i]+Matched[i])/2;
+                    Num++;
+                }
+                if ((Num==0)||(SumDir.Norm()==0))break;
+                CoordType NewNormal=SumDir;
+                NewNormal.Normalize();
+                CoordType NewOrigin=SumMid/Num;
+                ScalarType Change=(NewNormal-Normal).Norm()+
+                        fabs((NewOrigin-Origin)*NewNormal)/Box.Diag();
+                Normal=NewNormal;
+                Origin=NewOrigin;
+                if (Change<1e-6)break;
+            }
+
+            //trimmed mean distance of the mirror from the mesh
+            MirrorMatch(Projector,Points,Normal,Origin,Matched,SqDist);
+            ScalarType MaxSqD=TrimDistance(SqDist,trim);
+            ScalarType Score=0;
+            size_t Num=0;
+            for (size_t i=0;i<SqDist.size();i++)
+            {
+                if (SqDist[i]>MaxSqD)continue;
+                Score+=sqrt(SqDist[i]);
+                Num++;
+            }
+            Score/=std::max(Num,(size_t)1);
+            if (Score>=BestScore)continue;
+            BestScore=Score;
+            BestNormal=Normal;
+            BestOrigin=Origin;
+        }
+
+        //keep the positive side along the dominant axis, as for x=0
+        size_t MaxAxis=0;
+        for (size_t k=1;k<3;k++)
+            if (fabs(BestNormal.V(k))>fabs(BestNormal.V(MaxAxis)))MaxAxis=k;
+        if (BestNormal.V(MaxAxis)<0)BestNormal=-BestNormal;
+
+        vcg::Plane3<ScalarType> Pl;
+        Pl.Init(BestOrigin,BestNormal);
+        return Pl;
+    }
+
+    static CoordType SymmetricVect(const vcg::Plane3<ScalarType> &Plane,
+                                   const CoordType &vect)
+    {
+        vcg::Plane3<ScalarType> Pl=Plane;
         Pl.SetOffset(0);
         CoordType mirroredV=Pl.Mirror(vect);
         return mirroredV;
     }
 
-    static CoordType SymmetricPoint(const CoordType &pos)
+    static CoordType SymmetricPoint(const vcg::Plane3<ScalarType> &Plane,
+                                    const CoordType &pos)
     {
-        vcg::Plane3<ScalarType> Pl=SymmetryPlane();
-        CoordType mirrored=Pl.Mirror(pos);
+        CoordType mirrored=Plane.Mirror(pos);
         return mirrored;
     }
 
@@ -200,71 +552,170 @@ public:
             Deformed.vert[i].P()=Rigid*Deformed.vert[i].P();
     }
 
+    //vertices whose mirror is another vertex within twin_tolerance (relative
+    //to the bounding box diagonal) are matched directly through a hash of the
+    //positions, only the others are projected on the mesh
     static void FindSymmetricMap(MeshType &Template,
+                                 const vcg::Plane3<ScalarType> &Plane,
                                  std::vector<size_t> &OppFace,
-                                 std::vector<CoordType> &OppBary)
+                                 std::vector<CoordType> &OppBary,
+                                 ScalarType twin_tolerance=0.00001)
     {
-        vcg::GridStaticPtr<FaceType,ScalarType> MeshGrid;
-        MeshGrid.Set(Template.face.begin(),Template.face.end());
+        size_t NumV=Template.vert.size();
+        OppFace.resize(NumV);
+        OppBary.resize(NumV);
+        if (NumV==0)return;
+
+        vcg::Box3<ScalarType> Box;
+        std::vector<CoordType> VertPos(NumV);
+        for (size_t i=0;i<NumV;i++)
+        {
+            VertPos[i]=Template.vert[i].P();
+            Box.Add(VertPos[i]);
+        }
+        ScalarType Tol=Box.Diag()*twin_tolerance;
 
-        ScalarType MaxD=Template.bbox.Diag();
-        ScalarType MinD;
-        for (size_t i=0;i<Template.vert.size();i++)
+        //one face per vertex, with the index of the vertex in it
+        std::vector<size_t> VertFace(NumV,Template.face.size());
+        std::vector<size_t> VertFaceIdx(NumV,0);
+        for (size_t i=0;i<Template.face.size();i++)
+            for (size_t j=0;j<3;j++)
+            {
+                size_t IndexV=vcg::tri::Index(Template,Template.face[i].V(j));
+                if (VertFace[IndexV]<Template.face.size())continue;
+                VertFace[IndexV]=i;
+                VertFaceIdx[IndexV]=j;
+            }
+
+        std::vector<size_t> Unmatched;
+        std::vector<CoordType> UnmatchedPos;
+        if (Tol>0)
+        {
+            PositionHash<CoordType> Hash;
+            Hash.Build(VertPos,Tol);
+            for (size_t i=0;i<NumV;i++)
+            {
+                CoordType MirrPos=SymmetricPoint(Plane,VertPos[i]);
+                int Twin=Hash.Closest(MirrPos,Tol);
+                if ((Twin>=0)&&(VertFace[Twin]<Template.face.size()))
+                {
+                    OppFace[i]=VertFace[Twin];
+                    OppBary[i]=CoordType(0,0,0);
+                    OppBary[i].V(VertFaceIdx[Twin])=1;
+                    continue;
+                }
+                Unmatched.push_back(i);
+                UnmatchedPos.push_back(MirrPos);
+            }
+        }
+        else
         {
-            CoordType Pos=Template.vert[i].P();
-            CoordType MirrPos=SymmetricPoint(Pos);
-            CoordType closestPt,normI,Bary;
-            FaceType *f=vcg::tri::GetClosestFaceBase(Template,MeshGrid,MirrPos,
-                                                     MaxD,MinD,closestPt,normI,Bary);
-            assert(f!=NULL);
-            size_t IndexF=vcg::tri::Index(Template,f);
-            OppFace.push_back(IndexF);
-            OppBary.push_back(Bary);
+            for (size_t i=0;i<NumV;i++)
+            {
+                Unmatched.push_back(i);
+                UnmatchedPos.push_back(SymmetricPoint(Plane,VertPos[i]));
+            }
+        }
+        if (Unmatched.empty())return;
+
+        MeshProjector<MeshType> Projector;
+        Projector.Build(Template);
+        ProjectionBatch<ScalarType> Batch;
+        Projector.Project(UnmatchedPos,Batch);
+        for (size_t i=0;i<Unmatched.size();i++)
+        {
+            OppFace[Unmatched[i]]=Batch.FaceIdx[i];
+            OppBary[Unmatched[i]]=Batch.template Bary<CoordType>(i);
         }
     }
 
-    static void SymmetrizationStep(MeshType &Template,
-                                   MeshType &Deformed,
-                                   const std::vector<size_t> &OppFace,
-                                   const std::vector<CoordType> &OppBary,
-                                   ScalarType Damp=0.5)
+    //same as above, reusing Cache if it was computed on the same mesh
+    static void FindSymmetricMap(MeshType &Template,
+                                 const vcg::Plane3<ScalarType> &Plane,
+                                 SymmetricMap<CoordType> &Cache)
     {
-        assert(Template.vert.size()==Deformed.vert.size());
-        std::vector<CoordType> Displ0,Displ1;
-        for (size_t i=0;i<Template.vert.size();i++)
-            Displ0.push_back(Deformed.vert[i].P()-Template.vert[i].P());
+        if (Cache.IsValidFor(Template,Plane))return;
+        FindSymmetricMap(Template,Plane,Cache.OppFace,Cache.OppBary);
+        Cache.SetMesh(Template,Plane);
+    }
 
-        Displ1=Displ0;
+    static void InitStencil(MeshType &Template,
+                            const vcg::Plane3<ScalarType> &Plane,
+                            const std::vector<size_t> &OppFace,
+                            const std::vector<CoordType> &OppBary,
+                            SymmetryStencil &Stencil)
+    {
+        Stencil.Init(Template,OppFace,OppBary,Plane.Direction());
+    }
 
+    static void GetDisplacement(const MeshType &Template,
+                                const MeshType &Deformed,
+                                DisplacementField &Displ)
+    {
+        assert(Template.vert.size()==Deformed.vert.size());
+        Displ.Resize(Template.vert.size());
         for (size_t i=0;i<Template.vert.size();i++)
         {
-            size_t OppF=OppFace[i];
-            assert(OppF<Template.face.size());
-            CoordType OppB=OppBary[i];
-            size_t IndexMirrV0=vcg::tri::Index(Template,Template.face[OppF].V(0));
-            size_t IndexMirrV1=vcg::tri::Index(Template,Template.face[OppF].V(1));
-            size_t IndexMirrV2=vcg::tri::Index(Template,Template.face[OppF].V(2));
-            CoordType MirrorD= Displ0[IndexMirrV0]*OppB.X()+
-                               Displ0[IndexMirrV1]*OppB.Y()+
-                               Displ0[IndexMirrV2]*OppB.Z();
-            MirrorD=SymmetricVect(MirrorD);
-            Displ1[i]=Displ0[i]*Damp+MirrorD*(1-Damp);
+            CoordType D=Deformed.vert[i].cP()-Template.vert[i].cP();
+            Displ.X[i]=D.X();
+            Displ.Y[i]=D.Y();
+            Displ.Z[i]=D.Z();
         }
+    }
 
+    static void ApplyDisplacement(const MeshType &Template,
+                                  MeshType &Deformed,
+                                  const DisplacementField &Displ)
+    {
+        assert(Displ.Size()==Deformed.vert.size());
         for (size_t i=0;i<Deformed.vert.size();i++)
-            Deformed.vert[i].P()=Template.vert[i].P()+Displ1[i];
+            Deformed.vert[i].P()=Template.vert[i].cP()+CoordType(Displ.X[i],Displ.Y[i],Displ.Z[i]);
+    }
+
+    static void SymmetrizationStep(MeshType &Template,
+                                   MeshType &Deformed,
+                                   const vcg::Plane3<ScalarType> &Plane,
+                                   const std::vector<size_t> &OppFace,
+                                   const std::vector<CoordType> &OppBary,
+                                   ScalarType Damp=0.5)
+    {
+        SymmetryStencil Stencil;
+        InitStencil(Template,Plane,OppFace,OppBary,Stencil);
+        DisplacementField Displ;
+        GetDisplacement(Template,Deformed,Displ);
+        Stencil.Iterate(Displ,1,Damp);
+        ApplyDisplacement(Template,Deformed,Displ);
     }
 
+    //the mirror map is resolved once, then the steps only touch flat arrays;
+    //with direct_solve the symmetric displacement is solved for instead
     static void SymmetrizeDistortion(MeshType &Template,
                                      MeshType &Deformed,
+                                     const vcg::Plane3<ScalarType> &Plane,
                                      size_t step_num=10,
-                                     ScalarType Damp=0.5)
+                                     ScalarType Damp=0.5,
+                                     bool direct_solve=false,
+                                     size_t num_threads=0,
+                                     SymmetricMap<CoordType> *MapCache=NULL)
     {
-        std::vector<size_t> OppFace;
-        std::vector<CoordType> OppBary;
-        FindSymmetricMap(Template,OppFace,OppBary);
-        for (size_t i=0;i<step_num;i++)
-            SymmetrizationStep(Template,Deformed,OppFace,OppBary,Damp);
+        SymmetricMap<CoordType> LocalMap;
+        if (MapCache==NULL)MapCache=&LocalMap;
+        FindSymmetricMap(Template,Plane,*MapCache);
+
+        SymmetryStencil Stencil;
+        InitStencil(Template,Plane,MapCache->OppFace,MapCache->OppBary,Stencil);
+        DisplacementField Displ;
+        GetDisplacement(Template,Deformed,Displ);
+        bool Solved=false;
+        if (direct_solve)
+        {
+            Solved=Stencil.SolveDirect(Displ);
+            if (!Solved)
+                std::cout<<"WARNING: direct symmetrization failed, iterating"<<std::endl;
+        }
+        if (!Solved)
+            Stencil.Iterate(Displ,step_num,Damp,num_threads);
+        ApplyDisplacement(Template,Deformed,Displ);
     }
 
 };
@@ -279,6 +730,8 @@ class Symmetrizer
 
     TriMeshType &deformed_mesh;
     TriMeshType &reference_mesh;
+    //plane the deformed mesh is symmetrized and mirrored along
+    vcg::Plane3<ScalarType> symm_plane;
 
 //    std::vector<size_t> MapFace;
 //    std::vector<CoordType> MapBary;
@@ -359,11 +812,22 @@ class Symmetrizer
 
 public:
 
+    //number of symmetrization steps of the deformation
+    size_t symm_steps;
+    //solve for the symmetric deformation instead of iterating
+    bool direct_symmetrization;
+    //threads used by the symmetrization steps, 0 means one per core
+    size_t symm_threads;
+    //mirror map of the reference mesh kept across runs, if not NULL
+    SymmetricMap<CoordType> *map_cache;
+    //split and mirror the mesh in a single pass
+    bool fused_split;
+
     //std::vector<CoordType> DefField;
     //vcg::Plane3<ScalarType> SymmPlane;
 
-    static vcg::Plane3<ScalarType> SymmPlane()
-    {return SymmetrizeDeformation<TriMeshType>::SymmetryPlane();}
+    const vcg::Plane3<ScalarType> &SymmPlane()const
+    {return symm_plane;}
 
     //    void InitDeformedFromHalfMesh()
     //    {
@@ -399,16 +863,23 @@ public:
 
 //        ApplyDeformationField();
 //        vcg::tri::io::ExporterPLY<TriMeshType>::Save(deformed_mesh,"test0.ply");
-        SymmetrizeDeformation<TriMeshType>::SymmetrizeDistortion(reference_mesh,deformed_mesh,50);
+        SymmetrizeDeformation<TriMeshType>::SymmetrizeDistortion(reference_mesh,deformed_mesh,symm_plane,symm_steps,
+                                                                 0.5,direct_symmetrization,symm_threads,
+                                                                 map_cache);
 //        vcg::tri::io::ExporterPLY<TriMeshType>::Save(deformed_mesh,"test1.ply");
 
         //then apply the deformation
-        SymmetrizeMesh(deformed_mesh,SymmPlane());
+        if (fused_split)
+            SymmetrizeMeshFused(deformed_mesh,symm_plane);
+        else
+        {
+            SymmetrizeMesh(deformed_mesh,symm_plane);
 
-        vcg::tri::Clean<TriMeshType>::RemoveUnreferencedVertex(deformed_mesh);
-        vcg::tri::Allocator<TriMeshType>::CompactEveryVector(deformed_mesh);
+            vcg::tri::Clean<TriMeshType>::RemoveUnreferencedVertex(deformed_mesh);
+            vcg::tri::Allocator<TriMeshType>::CompactEveryVector(deformed_mesh);
 
-        deformed_mesh.UpdateAttributes();
+            deformed_mesh.UpdateAttributes();
+        }
 
         for (size_t i=0;i<deformed_mesh.face.size()/2;i++)
             deformed_mesh.face[i].C()=vcg::Color4b(72,209,204,255);
@@ -478,7 +949,7 @@ public:
     {
         deformed_mesh.Clear();
         vcg::tri::Append<TriMeshType,TriMeshType>::Mesh(deformed_mesh,half_def_mesh);
-        MirrorMesh(deformed_mesh,SymmPlane());
+        MirrorMesh(deformed_mesh,symm_plane);
     }
 
     void CopyFieldFromHalfDefMesh(TriMeshType &half_def_mesh)
@@ -492,8 +963,8 @@ public:
             CoordType PD2=half_def_mesh.face[i].PD2();
             deformed_mesh.face[i].PD1()=PD1;
             deformed_mesh.face[i].PD2()=PD2;
-            deformed_mesh.face[OffsetF+i].PD1()=SymmPlane().Mirror(PD1);
-            deformed_mesh.face[OffsetF+i].PD2()=SymmPlane().Mirror(PD2);
+            deformed_mesh.face[OffsetF+i].PD1()=SymmetrizeDeformation<TriMeshType>::SymmetricVect(symm_plane,PD1);
+            deformed_mesh.face[OffsetF+i].PD2()=SymmetrizeDeformation<TriMeshType>::SymmetricVect(symm_plane,PD2);
         }
         vcg::tri::CrossField<TriMeshType>::UpdateSingularByCross(deformed_mesh);
         vcg::tri::CrossField<TriMeshType>::SetVertCrossVectorFromFace(deformed_mesh);
@@ -524,11 +995,11 @@ public:
             CoordType Pos=half_def_mesh.vert[i].P();
             deformed_mesh.vert[i].P()=Pos;
 
-            typename TriMeshType::CoordType proj=SymmPlane().Projection(Pos);
+            typename TriMeshType::CoordType proj=symm_plane.Projection(Pos);
             if ((proj-Pos).Norm()<alpha)
                 deformed_mesh.vert[OffsetF+i].P()=Pos;
             else
-                deformed_mesh.vert[OffsetF+i].P()=SymmPlane().Mirror(Pos);
+                deformed_mesh.vert[OffsetF+i].P()=symm_plane.Mirror(Pos);
         }
 
         //then copy the selected edges
@@ -554,8 +1025,16 @@ public:
     }
 
     Symmetrizer(TriMeshType &_deformed_mesh,
-                TriMeshType &_reference_mesh):deformed_mesh(_deformed_mesh),reference_mesh(_reference_mesh)
-    {}
+                TriMeshType &_reference_mesh,
+                const vcg::Plane3<ScalarType> &_symm_plane):deformed_mesh(_deformed_mesh),
+        reference_mesh(_reference_mesh),symm_plane(_symm_plane)
+    {
+        symm_steps=50;
+        direct_symmetrization=false;
+        symm_threads=0;
+        map_cache=NULL;
+        fused_split=true;
+    }
 
 };
 
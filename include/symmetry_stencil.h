@@ -0,0 +1,180 @@
+#ifndef SYMMETRY_STENCIL
+#define SYMMETRY_STENCIL
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+#include <Eigen/Sparse>
+#include "parallel_for.h"
+
+//per vertex displacements stored as structure of arrays
+struct DisplacementField
+{
+    std::vector<double> X,Y,Z;
+
+    void Resize(size_t Size)
+    {
+        X.resize(Size);
+        Y.resize(Size);
+        Z.resize(Size);
+    }
+
+    size_t Size()const{return X.size();}
+
+    void Swap(DisplacementField &Other)
+    {
+        X.swap(Other.X);
+        Y.swap(Other.Y);
+        Z.swap(Other.Z);
+    }
+};
+
+//for each vertex the three vertices of the face its mirror falls in,
+//with the barycentric coordinates of the mirror, stored as flat arrays
+//so a symmetrization step is a sparse matrix vector product without
+//any lookup in the mesh; Mirror is the reflection of the displacements
+class SymmetryStencil
+{
+    std::vector<size_t> V0,V1,V2;
+    std::vector<double> B0,B1,B2;
+    double Mirror[3][3];
+
+public:
+
+    size_t Size()const{return V0.size();}
+
+    template <class MeshType>
+    void Init(const MeshType &Template,
+              const std::vector<size_t> &OppFace,
+              const std::vector<typename MeshType::CoordType> &OppBary,
+              const typename MeshType::CoordType &PlaneNormal)
+    {
+        assert(OppFace.size()==Template.vert.size());
+        assert(OppBary.size()==Template.vert.size());
+        size_t NumV=Template.vert.size();
+        V0.resize(NumV);V1.resize(NumV);V2.resize(NumV);
+        B0.resize(NumV);B1.resize(NumV);B2.resize(NumV);
+        const typename MeshType::VertexType *VertBase=(NumV>0)?&Template.vert[0]:NULL;
+        for (size_t i=0;i<NumV;i++)
+        {
+            size_t OppF=OppFace[i];
+            assert(OppF<Template.face.size());
+            V0[i]=Template.face[OppF].cV(0)-VertBase;
+            V1[i]=Template.face[OppF].cV(1)-VertBase;
+            V2[i]=Template.face[OppF].cV(2)-VertBase;
+            B0[i]=OppBary[i].X();
+            B1[i]=OppBary[i].Y();
+            B2[i]=OppBary[i].Z();
+        }
+
+        //reflection I-2nn^T
+        double N[3]={PlaneNormal.X(),PlaneNormal.Y(),PlaneNormal.Z()};
+        double Norm=std::sqrt(N[0]*N[0]+N[1]*N[1]+N[2]*N[2]);
+        assert(Norm>0);
+        for (size_t a=0;a<3;a++)
+            for (size_t b=0;b<3;b++)
+                Mirror[a][b]=((a==b)?1:0)-2*N[a]*N[b]/(Norm*Norm);
+    }
+
+    //Out=In*Damp+Mirror(interpolated In)*(1-Damp), Out must be sized as In
+    void Step(const DisplacementField &In,
+              DisplacementField &Out,
+              double Damp,
+              size_t num_threads=0)const
+    {
+        assert(In.Size()==Size());
+        assert(Out.Size()==Size());
+        const double *X=In.X.data(),*Y=In.Y.data(),*Z=In.Z.data();
+        ParallelForRange(Size(),num_threads,
+                         [&](size_t Begin,size_t End,size_t)
+        {
+            for (size_t i=Begin;i<End;i++)
+            {
+                double IX=X[V0[i]]*B0[i]+X[V1[i]]*B1[i]+X[V2[i]]*B2[i];
+                double IY=Y[V0[i]]*B0[i]+Y[V1[i]]*B1[i]+Y[V2[i]]*B2[i];
+                double IZ=Z[V0[i]]*B0[i]+Z[V1[i]]*B1[i]+Z[V2[i]]*B2[i];
+                double MX=Mirror[0][0]*IX+Mirror[0][1]*IY+Mirror[0][2]*IZ;
+                double MY=Mirror[1][0]*IX+Mirror[1][1]*IY+Mirror[1][2]*IZ;
+                double MZ=Mirror[2][0]*IX+Mirror[2][1]*IY+Mirror[2][2]*IZ;
+                Out.X[i]=X[i]*Damp+MX*(1-Damp);
+                Out.Y[i]=Y[i]*Damp+MY*(1-Damp);
+                Out.Z[i]=Z[i]*Damp+MZ*(1-Damp);
+            }
+        });
+    }
+
+    //step_num damped steps, ping-ponging between Field and a single buffer
+    void Iterate(DisplacementField &Field,
+                 size_t step_num,
+                 double Damp,
+                 size_t num_threads=0)const
+    {
+        DisplacementField Buffer;
+        Buffer.Resize(Field.Size());
+        for (size_t s=0;s<step_num;s++)
+        {
+            Step(Field,Buffer,Damp,num_threads);
+            Field.Swap(Buffer);
+        }
+    }
+
+    //the symmetric displacement closest to Field: with T the mirrored
+    //interpolation minimizes |D-Field|^2+Weight*|D-T(D)|^2, which is
+    //where the iterations converge to when the mirror map is exact
+    bool SolveDirect(DisplacementField &Field,
+                     double Weight=1000)const
+    {
+        typedef Eigen::Triplet<double> Triplet;
+        size_t NumV=Size();
+        assert(Field.Size()==NumV);
+
+        //L=I-T
+        std::vector<Triplet> Entries;
+        Entries.reserve(NumV*30);
+        for (size_t i=0;i<NumV;i++)
+        {
+            size_t VertS[3]={V0[i],V1[i],V2[i]};
+            double BaryS[3]={B0[i],B1[i],B2[i]};
+            for (size_t a=0;a<3;a++)
+            {
+                Entries.push_back(Triplet(i*3+a,i*3+a,1));
+                for (size_t k=0;k<3;k++)
+                    for (size_t b=0;b<3;b++)
+                    {
+                        double Val=BaryS[k]*Mirror[a][b];
+                        if (Val==0)continue;
+                        Entries.push_back(Triplet(i*3+a,VertS[k]*3+b,-Val));
+                    }
+            }
+        }
+        Eigen::SparseMatrix<double> L(NumV*3,NumV*3);
+        L.setFromTriplets(Entries.begin(),Entries.end());
+
+        Eigen::SparseMatrix<double> Id(NumV*3,NumV*3);
+        Id.setIdentity();
+        Eigen::SparseMatrix<double> A=Id+Weight*(Eigen::SparseMatrix<double>(L.transpose())*L);
+
+        Eigen::VectorXd Rhs(NumV*3);
+        for (size_t i=0;i<NumV;i++)
+        {
+            Rhs(i*3+0)=Field.X[i];
+            Rhs(i*3+1)=Field.Y[i];
+            Rhs(i*3+2)=Field.Z[i];
+        }
+
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > Solver(A);
+        if (Solver.info()!=Eigen::Success)return false;
+        Eigen::VectorXd Sol=Solver.solve(Rhs);
+        if (Solver.info()!=Eigen::Success)return false;
+
+        for (size_t i=0;i<NumV;i++)
+        {
+            Field.X[i]=Sol(i*3+0);
+            Field.Y[i]=Sol(i*3+1);
+            Field.Z[i]=Sol(i*3+2);
+        }
+        return true;
+    }
+};
+
+#endif
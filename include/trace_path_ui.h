@@ -4,6 +4,7 @@
 #include <vcg/space/index/grid_static_ptr.h>
 #include <vcg/complex/algorithms/closest.h>
 #include "vcg/complex/algorithms/geodesic.h"
+#include "mesh_projector.h"
 
 template <class TriMeshType>
 class PathUI
@@ -57,17 +58,22 @@ class PathUI
         }
     }
 
-    void Reproject(vcg::GridStaticPtr<FaceType,ScalarType> &GridF)
+    //move the vertices back on the surface as it was before smoothing
+    void Reproject(const MeshProjector<TriMeshType> &Projector)
     {
+        std::vector<size_t> ToProject;
+        std::vector<CoordType> Points;
         for (size_t i=0;i<mesh.vert.size();i++)
         {
-            ScalarType maxD=mesh.bbox.Diag();
-            ScalarType minD;
-            CoordType closestPt;
             if (mesh.vert[i].IsB())continue;
-            vcg::tri::GetClosestFaceBase(mesh,GridF,mesh.vert[i].P(),maxD,minD,closestPt);
-            mesh.vert[i].P()=closestPt;
+            ToProject.push_back(i);
+            Points.push_back(mesh.vert[i].P());
         }
+        ProjectionBatch<ScalarType> Batch;
+        Projector.Project(Points,Batch);
+        for (size_t i=0;i<ToProject.size();i++)
+            mesh.vert[ToProject[i]].P()=Projector.Interpolate(Batch.FaceIdx[i],
+                                                              Batch.template Bary<CoordType>(i));
     }
 
     void SnapPathOnVertices(const std::vector<std::vector<CoordType> > &PickedPoints)
@@ -115,8 +121,8 @@ class PathUI
             }
         }
 
-        vcg::GridStaticPtr<FaceType,ScalarType> GridF;
-        GridF.Set(mesh.face.begin(),mesh.face.end());
+        MeshProjector<TriMeshType> Projector;
+        Projector.Build(mesh);
 
         int dilate_step=1;
         for (int i=0;i<dilate_step;i++)
@@ -133,7 +139,7 @@ class PathUI
             //then the rest
             SmoothVert(VertexPathSet,OnPath,false,0.5);
 
-            Reproject(GridF);
+            Reproject(Projector);
         }
         //UpdateMesh();
     }
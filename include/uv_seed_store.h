@@ -0,0 +1,178 @@
+#ifndef UV_SEED_STORE
+#define UV_SEED_STORE
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <cmath>
+#include <cassert>
+#include <Eigen/Core>
+#include <vcg/space/point2.h>
+
+//keep the UVs of the last successfully flattened patches, indexed by the 3D position
+//of their vertices, so a candidate obtained by merging (or splitting) them can be
+//seeded with an already valid layout instead of being solved from scratch;
+//the seed found depends on the order the patches were stored, so it is
+//deterministic only as long as the candidates are evaluated serially
+template <class MeshType>
+class UVSeedStore
+{
+    typedef typename MeshType::CoordType CoordType;
+    typedef typename MeshType::ScalarType ScalarType;
+
+    typedef std::map<CoordType,vcg::Point2d> SeedRecord;
+
+    std::deque<SeedRecord> Records;
+    size_t MaxRecords;
+    std::mutex Lock;
+
+    static size_t Coverage(const SeedRecord &Rec,
+                           const std::vector<CoordType> &Pos,
+                           const std::vector<bool> &Skip)
+    {
+        size_t Num=0;
+        for (size_t i=0;i<Pos.size();i++)
+        {
+            if (Skip[i])continue;
+            if (Rec.count(Pos[i])>0)Num++;
+        }
+        return Num;
+    }
+
+    //rigid transformation bringing the UVs of Rec1 in the frame of Rec0,
+    //fitted on the vertices shared by the two records
+    static bool AlignRecords(const SeedRecord &Rec0,
+                             const SeedRecord &Rec1,
+                             ScalarType &Angle,
+                             vcg::Point2d &Center0,
+                             vcg::Point2d &Center1)
+    {
+        std::vector<vcg::Point2d> UV0,UV1;
+        typename SeedRecord::const_iterator IteR;
+        for (IteR=Rec1.begin();IteR!=Rec1.end();IteR++)
+        {
+            typename SeedRecord::const_iterator IteR0=Rec0.find((*IteR).first);
+            if (IteR0==Rec0.end())continue;
+            UV0.push_back((*IteR0).second);
+            UV1.push_back((*IteR).second);
+        }
+        if (UV0.size()<2)return false;
+
+        Center0=vcg::Point2d(0,0);
+        Center1=vcg::Point2d(0,0);
+        for (size_t i=0;i<UV0.size();i++)
+        {
+            Center0+=UV0[i];
+            Center1+=UV1[i];
+        }
+        Center0/=UV0.size();
+        Center1/=UV1.size();
+
+        double Dot=0,Cross=0;
+        for (size_t i=0;i<UV0.size();i++)
+        {
+            vcg::Point2d Q0=UV0[i]-Center0;
+            vcg::Point2d Q1=UV1[i]-Center1;
+            Dot+=Q1*Q0;
+            Cross+=Q1^Q0;
+        }
+        if ((Dot==0)&&(Cross==0))return false;
+        Angle=atan2(Cross,Dot);
+        return true;
+    }
+
+public:
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Records.clear();
+    }
+
+    //store the per vertex UVs of a patch whose layout respects the bounds
+    void Store(const MeshType &m)
+    {
+        SeedRecord Rec;
+        for (size_t i=0;i<m.vert.size();i++)
+        {
+            if (m.vert[i].IsD())continue;
+            Rec[m.vert[i].cP()]=vcg::Point2d(m.vert[i].cT().P().X(),
+                                             m.vert[i].cT().P().Y());
+        }
+        std::lock_guard<std::mutex> guard(Lock);
+        Records.push_back(Rec);
+        while (Records.size()>MaxRecords)
+            Records.pop_front();
+    }
+
+    //assemble an initial layout for m from at most two stored patches,
+    //the one covering most vertices and the one covering most of the remaining,
+    //rigidly aligned on the shared vertices; fails if some vertex is not covered
+    bool GetSeed(const MeshType &m,Eigen::MatrixXd &V_uv)
+    {
+        std::vector<CoordType> Pos;
+        for (size_t i=0;i<m.vert.size();i++)
+            Pos.push_back(m.vert[i].cP());
+
+        std::lock_guard<std::mutex> guard(Lock);
+        if (Records.size()==0)return false;
+
+        std::vector<bool> Covered(Pos.size(),false);
+        size_t Best0=0;
+        size_t Cov0=0;
+        for (size_t i=0;i<Records.size();i++)
+        {
+            size_t CurrCov=Coverage(Records[i],Pos,Covered);
+            if (CurrCov<=Cov0)continue;
+            Cov0=CurrCov;
+            Best0=i;
+        }
+        if (Cov0==0)return false;
+
+        V_uv=Eigen::MatrixXd(Pos.size(),2);
+        for (size_t i=0;i<Pos.size();i++)
+        {
+            typename SeedRecord::const_iterator IteR=Records[Best0].find(Pos[i]);
+            if (IteR==Records[Best0].end())continue;
+            V_uv(i,0)=(*IteR).second.X();
+            V_uv(i,1)=(*IteR).second.Y();
+            Covered[i]=true;
+        }
+        if (Cov0==Pos.size())return true;
+
+        size_t Best1=0;
+        size_t Cov1=0;
+        for (size_t i=0;i<Records.size();i++)
+        {
+            if (i==Best0)continue;
+            size_t CurrCov=Coverage(Records[i],Pos,Covered);
+            if (CurrCov<=Cov1)continue;
+            Cov1=CurrCov;
+            Best1=i;
+        }
+        if (Cov0+Cov1<Pos.size())return false;
+
+        ScalarType Angle;
+        vcg::Point2d Center0,Center1;
+        if (!AlignRecords(Records[Best0],Records[Best1],Angle,Center0,Center1))
+            return false;
+
+        double CosA=cos(Angle);
+        double SinA=sin(Angle);
+        for (size_t i=0;i<Pos.size();i++)
+        {
+            if (Covered[i])continue;
+            typename SeedRecord::const_iterator IteR=Records[Best1].find(Pos[i]);
+            assert(IteR!=Records[Best1].end());
+            vcg::Point2d Q=(*IteR).second-Center1;
+            V_uv(i,0)=CosA*Q.X()-SinA*Q.Y()+Center0.X();
+            V_uv(i,1)=SinA*Q.X()+CosA*Q.Y()+Center0.Y();
+        }
+        return true;
+    }
+
+    UVSeedStore(size_t _MaxRecords=16):MaxRecords(_MaxRecords){}
+};
+
+#endif
@@ -58,6 +58,7 @@
 #include "wrap/qt/Outline2ToQImage.h"
 #include <svg_exporter.h>
 #include "parafashion.h"
+#include "parafashion_io.h"
 #include <vcg/complex/algorithms/polygonal_algorithms.h>
 //#include "parafashion_interface.h"
 
@@ -496,12 +497,8 @@ void DoGenerateSVG(std::string ProjM)
     //THEN SAVE THE PATCH DATA
     std::string pathPartitions=ProjM;
     pathPartitions=ProjM+"_patch.txt";
-    FILE *F=fopen(pathPartitions.c_str(),"wt");
-    assert(F!=NULL);
-    fprintf(F,"%d\n",(int)deformed_mesh.face.size());
-    for (size_t i=0;i<deformed_mesh.face.size();i++)
-        fprintf(F,"%d\n",(int)deformed_mesh.face[i].Q());
-    fclose(F);
+    if (!SavePatchPartition(deformed_mesh,pathPartitions))
+        std::cout<<"Error Saving Partition"<<std::endl;
 
     //SAVE THE SVG
     std::string pathPatch=ProjM;
@@ -545,29 +542,9 @@ void TW_CALL SaveData(void *)
     std::string saveMeshName=ProjM+std::string("_patch.obj");
 
     //SAVE THE MESH
-    TraceMesh saveM;
-    vcg::tri::Append<TraceMesh,TraceMesh>::Mesh(saveM,deformed_mesh);
-
-
-    vcg::tri::Clean<TraceMesh>::RemoveDuplicateVertex(saveM);
+    SavePatchMesh(deformed_mesh,saveMeshName,CenterDef);
 
-    for (size_t i=0;i<saveM.vert.size();i++)
-        saveM.vert[i].P()+=CenterDef;
-
-    saveM.UpdateAttributes();
-    vcg::tri::io::ExporterOBJ<TraceMesh>::Save(saveM,saveMeshName.c_str(),
-                                               vcg::tri::io::Mask::IOM_WEDGTEXCOORD|
-                                               vcg::tri::io::Mask::IOM_FACECOLOR);
-
-    //THEN SAVE THE PATCH DATA
-    std::string pathPartitions=ProjM;
-    pathPartitions=ProjM+"_patch.txt";
-    FILE *F=fopen(pathPartitions.c_str(),"wt");
-    assert(F!=NULL);
-    fprintf(F,"%d\n",(int)deformed_mesh.face.size());
-    for (size_t i=0;i<deformed_mesh.face.size();i++)
-        fprintf(F,"%d\n",(int)deformed_mesh.face[i].Q());
-    fclose(F);
+    //THEN SAVE THE PATCH DATA (also done by DoGenerateSVG)
 
     //    //SAVE THE SVG
     //    std::string pathPatch=ProjM;
@@ -591,20 +568,8 @@ void TW_CALL SaveData(void *)
     //THEN save the mesh in UV
     std::string pathUV=ProjM;
     pathUV=ProjM+"_UV.txt";
-    F=fopen(pathUV.c_str(),"wt");
-    assert(F!=NULL);
-    fprintf(F,"%d\n",(int)deformed_mesh.face.size());
-    for (size_t i=0;i<deformed_mesh.face.size();i++)
-    {
-        vcg::Point2<ScalarType> T0=deformed_mesh.face[i].WT(0).P();
-        vcg::Point2<ScalarType> T1=deformed_mesh.face[i].WT(1).P();
-        vcg::Point2<ScalarType> T2=deformed_mesh.face[i].WT(2).P();
-        fprintf(F,"%f,%f;%f,%f;%f,%f\n",
-                T0.X(),T0.Y(),
-                T1.X(),T1.Y(),
-                T2.X(),T2.Y());
-    }
-    fclose(F);
+    if (!SavePerWedgeUV(deformed_mesh,pathUV))
+        std::cout<<"Error Saving UV"<<std::endl;
 
 }
 
@@ -749,6 +714,8 @@ void InitBar(QWidget *w) // AntTweakBar menu
 
     TwAddSeparator(barFashion,NULL,NULL);
 
+    TwAddVarRW(barFashion,"UseSymm",TW_TYPE_BOOLCPP,&PFashion.use_symmetry," label='Use Symmetry'");
+    TwAddVarRW(barFashion,"AutoPlane",TW_TYPE_BOOLCPP,&PFashion.auto_symmetry_plane," label='Estimate Symm Plane'");
     TwAddButton(barFashion,"SymmetrizeDef",SymmetrizeDeformed,0,"label='Symmetrize Deformed'");
 
     TwEnumVal fieldmodes[4] = { {FMCurvatureOnly, "Curvature Only"},
@@ -816,6 +783,19 @@ void InitBar(QWidget *w) // AntTweakBar menu
     TwAddVarRW(barFashion,"FinalRem",TW_TYPE_BOOLCPP,&PFashion.final_removal," label='Final Removal'");
 #ifdef MULTI_FRAME
     TwAddVarRW(barFashion,"UseFr",TW_TYPE_BOOLCPP,&PFashion.useFrames," label='Use Frames'");
+    TwAddVarRW(barFashion,"FrBudget",TW_TYPE_UINT32,&PFashion.frame_budget," label='Frame Budget'");
+    TwEnumVal frameselection[3] = { {FSUniform, "Uniform"},
+                                    {FSMaxStretch, "Max Stretch"},
+                                    {FSCluster, "Cluster"}
+                                  };
+    TwType frameSelection = TwDefineEnum("FrameSelection", frameselection, 3);
+    TwAddVarRW(barFashion, "Frame Selection", frameSelection, &PFashion.frame_selection, " help='Change how the poses are picked.' ");
+    TwEnumVal fieldprecision[3] = { {FPDouble, "Double"},
+                                    {FPFloat, "Float"},
+                                    {FPQuantized, "Quantized"}
+                                  };
+    TwType fieldPrecision = TwDefineEnum("FieldPrecision", fieldprecision, 3);
+    TwAddVarRW(barFashion, "Frame Precision", fieldPrecision, &PFashion.field_precision, " help='Precision of the per frame curvature and stretch.' ");
 #endif
 
     TwAddButton(barFashion,"BatchProcess",BatchProcess,0,"label='Batch Process'");
@@ -1222,7 +1202,7 @@ void MyGLWidget::paintGL ()
 
     if ((drawSymmetryPlane)&&(draw3D))
     {
-        GlDrawPlane(Symmetrizer<TraceMesh>::SymmPlane(),deformed_mesh.bbox.Diag()/3.8);//,deformed_mesh.bbox.Center());
+        GlDrawPlane(PFashion.symmetry_plane,deformed_mesh.bbox.Diag()/3.8);//,deformed_mesh.bbox.Center());
     }
 
     if  (user_is_picking)